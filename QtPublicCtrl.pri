@@ -0,0 +1,38 @@
+# Sources of the library, shared by QtPublicCtrl.pro and the tools
+# that build them in.
+
+QT       += widgets concurrent
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/qtcolorpicker.cpp \
+    $$PWD/qtcolorfield.cpp \
+    $$PWD/qtcolormap.cpp \
+    $$PWD/qtcolorpalette.cpp \
+    $$PWD/qtcolorparser.cpp \
+    $$PWD/qtcolorspace.cpp \
+    $$PWD/qteyedropper.cpp \
+    $$PWD/qtgradienteditor.cpp \
+    $$PWD/qtpalettefile.cpp \
+    $$PWD/qtpalettequantizer.cpp \
+    $$PWD/qtpaletteremapper.cpp \
+    $$PWD/qtpalettetable.cpp \
+    $$PWD/qtrecentcolors.cpp \
+    $$PWD/qtswatchcache.cpp
+
+HEADERS +=\
+    $$PWD/qtcolorpicker.h \
+    $$PWD/qtcolorfield.h \
+    $$PWD/qtcolormap.h \
+    $$PWD/qtcolorpalette.h \
+    $$PWD/qtcolorparser.h \
+    $$PWD/qtcolorspace.h \
+    $$PWD/qteyedropper.h \
+    $$PWD/qtgradienteditor.h \
+    $$PWD/qtpalettefile.h \
+    $$PWD/qtpalettequantizer.h \
+    $$PWD/qtpaletteremapper.h \
+    $$PWD/qtpalettetable.h \
+    $$PWD/qtrecentcolors.h \
+    $$PWD/qtswatchcache.h
@@ -4,18 +4,12 @@
 #
 #-------------------------------------------------
 
-QT       += widgets
-
 TARGET = QtPublicCtrl
 TEMPLATE = lib
 
 DEFINES += QTPUBLICCTRL_LIBRARY
 
-SOURCES += \
-    qtcolorpicker.cpp
-
-HEADERS +=\
-    qtcolorpicker.h
+include(QtPublicCtrl.pri)
 
 unix {
     target.path = /usr/lib
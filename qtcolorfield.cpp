@@ -0,0 +1,370 @@
+#include <QtGui/QMouseEvent>
+#include <QtGui/QPainter>
+#include <QtCore/QVector>
+#include <QtCore/qmath.h>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include "qtcolorspace.h"
+#include "qtcolorfield.h"
+#include "qtswatchcache.h"
+
+enum { StripWidth = 12, StripSpacing = 4, MarkerRadius = 5 };
+
+// Chroma at the right edge of the field in Oklch mode; a little more
+// than the most saturated sRGB color.
+static const float MaxChroma = 0.33f;
+
+// Lightness and chroma of the hue strip in Oklch mode.
+static const float StripLightness = 0.75f;
+static const float StripChroma = 0.12f;
+
+static inline QRgb oklchToRgb(float lightness, float chroma, float hue)
+{
+	const float radians = hue * float(M_PI / 180.0);
+	QtLabColor lab;
+	lab.l = lightness;
+	lab.a = chroma * cosf(radians);
+	lab.b = chroma * sinf(radians);
+	return QtColorSpace::fromOklab(lab);
+}
+
+/*! \internal
+
+Renders one line of a field or strip background. The lines of an
+image are independent, so they are spread over the thread pool.
+*/
+struct QtColorFieldLine
+{
+	typedef void result_type;
+
+	uchar *bits;
+	int bytesPerLine;
+	int width;
+	int height;
+	bool oklch;
+	bool strip;
+	float hue;
+
+	void operator()(int y) const
+	{
+		QRgb *line = reinterpret_cast<QRgb *>(bits + y * bytesPerLine);
+		const float vy = height > 1 ? 1.0f - float(y) / (height - 1) : 1.0f;
+
+		if (strip) {
+			const float stripHue = height > 1 ? 360.0f * y / (height - 1) : 0.0f;
+			const QRgb rgb = oklch ? oklchToRgb(StripLightness, StripChroma, stripHue) : QtColorSpace::fromHsv(stripHue, 1, 1);
+			for (int x = 0; x < width; ++x)
+				line[x] = rgb;
+			return;
+		}
+
+		for (int x = 0; x < width; ++x) {
+			const float vx = width > 1 ? float(x) / (width - 1) : 0.0f;
+			line[x] = oklch ? oklchToRgb(vy, vx * MaxChroma, hue) : QtColorSpace::fromHsv(hue, vx, vy);
+		}
+	}
+};
+
+static void renderLines(QImage &image, bool oklch, bool strip, float hue)
+{
+	QtColorFieldLine line;
+	line.bits = image.bits();
+	line.bytesPerLine = image.bytesPerLine();
+	line.width = image.width();
+	line.height = image.height();
+	line.oklch = oklch;
+	line.strip = strip;
+	line.hue = hue;
+
+	QVector<int> lines(image.height());
+	for (int y = 0; y < lines.size(); ++y)
+		lines[y] = y;
+	QtConcurrent::blockingMap(lines, line);
+}
+
+/*!
+Constructs a color field. If \a withAlphaChannel is true, an alpha
+strip is shown to the right of the hue strip.
+*/
+QtColorField::QtColorField(QWidget *parent, bool withAlphaChannel)
+	: QWidget(parent), m(Hsv), withAlpha(withAlphaChannel),
+	h(0), fx(0), fy(0), a(1), c(Qt::black), dragged(NoPart), fieldHue(-1)
+{
+	setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	setAttribute(Qt::WA_OpaquePaintEvent);
+	setCursor(Qt::CrossCursor);
+}
+
+/*!
+Destructs the color field.
+*/
+QtColorField::~QtColorField()
+{
+}
+
+/*!
+Returns the color under the markers.
+*/
+QColor QtColorField::color() const
+{
+	return c;
+}
+
+/*!
+Moves the markers to \a color. Unlike dragging, this does not emit
+colorChanged().
+*/
+void QtColorField::setColor(const QColor &color)
+{
+	if (!color.isValid())
+		return;
+
+	c = color;
+	a = withAlpha ? color.alphaF() : 1.0;
+	if (m == Hsv) {
+		qreal hue, saturation, value, alpha;
+		color.getHsvF(&hue, &saturation, &value, &alpha);
+		if (hue >= 0)
+			h = hue * 360.0;
+		fx = saturation;
+		fy = value;
+	} else {
+		const QtLabColor lab = QtColorSpace::toOklab(color.rgb());
+		const float chroma = sqrtf(lab.a * lab.a + lab.b * lab.b);
+		if (chroma > 1e-4f)
+			h = fmod(atan2(lab.b, lab.a) * 180.0 / M_PI + 360.0, 360.0);
+		fx = qBound(0.0f, chroma / MaxChroma, 1.0f);
+		fy = qBound(0.0f, lab.l, 1.0f);
+	}
+	update();
+}
+
+/*!
+Sets the color model spanned by the field.
+*/
+void QtColorField::setModel(Model model)
+{
+	if (m == model)
+		return;
+
+	m = model;
+	fieldHue = -1;
+	hueImage = QImage();
+	setColor(c);
+}
+
+QtColorField::Model QtColorField::model() const
+{
+	return m;
+}
+
+/*!
+Shows or hides the alpha strip.
+*/
+void QtColorField::setAlphaEnabled(bool enabled)
+{
+	withAlpha = enabled;
+	fieldHue = -1;
+	update();
+}
+
+bool QtColorField::alphaEnabled() const
+{
+	return withAlpha;
+}
+
+/*! \internal
+*/
+QSize QtColorField::sizeHint() const
+{
+	return QSize(160, 120);
+}
+
+/*! \internal
+*/
+QRect QtColorField::fieldRect() const
+{
+	const int strips = withAlpha ? 2 : 1;
+	return QRect(0, 0, qMax(1, width() - strips * (StripWidth + StripSpacing)), height());
+}
+
+QRect QtColorField::hueRect() const
+{
+	return QRect(fieldRect().right() + 1 + StripSpacing, 0, StripWidth, height());
+}
+
+QRect QtColorField::alphaRect() const
+{
+	return withAlpha ? QRect(hueRect().right() + 1 + StripSpacing, 0, StripWidth, height()) : QRect();
+}
+
+/*! \internal
+
+Returns the area covered by the field marker.
+*/
+QRect QtColorField::markerRect() const
+{
+	const QRect field = fieldRect();
+	const QPoint center(field.left() + qRound(fx * (field.width() - 1)),
+		field.top() + qRound((1 - fy) * (field.height() - 1)));
+	return QRect(center, center).adjusted(-MarkerRadius - 2, -MarkerRadius - 2, MarkerRadius + 2, MarkerRadius + 2);
+}
+
+/*! \internal
+*/
+QtColorField::Part QtColorField::partAt(const QPoint &pos) const
+{
+	if (fieldRect().contains(pos))
+		return FieldPart;
+	if (hueRect().contains(pos))
+		return HuePart;
+	if (withAlpha && alphaRect().contains(pos))
+		return AlphaPart;
+	return NoPart;
+}
+
+/*! \internal
+
+Moves the marker of the dragged part to \a pos and repaints only
+what this changes: the two marker positions when dragging in the
+field, everything when the hue changes.
+*/
+void QtColorField::track(const QPoint &pos)
+{
+	const QRect field = fieldRect();
+	const qreal ty = field.height() > 1 ? qBound(0.0, qreal(pos.y() - field.top()) / (field.height() - 1), 1.0) : 0.0;
+
+	switch (dragged) {
+	case FieldPart: {
+		const QRect oldMarker = markerRect();
+		fx = field.width() > 1 ? qBound(0.0, qreal(pos.x() - field.left()) / (field.width() - 1), 1.0) : 0.0;
+		fy = 1 - ty;
+		updateColor();
+		update(oldMarker | markerRect() | alphaRect());
+		break;
+	}
+	case HuePart:
+		h = ty * 360.0;
+		updateColor();
+		update();
+		break;
+	case AlphaPart:
+		a = 1 - ty;
+		updateColor();
+		update(alphaRect());
+		break;
+	default:
+		break;
+	}
+}
+
+/*! \internal
+*/
+void QtColorField::updateColor()
+{
+	if (m == Hsv)
+		c = QColor::fromHsvF(qMin(h, 359.99) / 360.0, fx, fy, a);
+	else
+		c = QColor::fromRgba(oklchToRgb(float(fy), float(fx) * MaxChroma, float(h)));
+	c.setAlphaF(a);
+
+	emit colorChanged(c);
+}
+
+/*! \internal
+
+Renders the field background for the current hue and size.
+*/
+void QtColorField::renderField()
+{
+	const qreal dpr = devicePixelRatioF();
+	fieldImage = QImage(fieldRect().size() * dpr, QImage::Format_RGB32);
+	fieldImage.setDevicePixelRatio(dpr);
+	renderLines(fieldImage, m == Oklch, false, float(h));
+	fieldHue = h;
+}
+
+/*! \internal
+
+Renders the hue strip for the current size.
+*/
+void QtColorField::renderHue()
+{
+	const qreal dpr = devicePixelRatioF();
+	hueImage = QImage(QSize(StripWidth, height()) * dpr, QImage::Format_RGB32);
+	hueImage.setDevicePixelRatio(dpr);
+	renderLines(hueImage, m == Oklch, true, 0);
+}
+
+/*! \internal
+*/
+void QtColorField::paintEvent(QPaintEvent *)
+{
+	const qreal dpr = devicePixelRatioF();
+	const QRect field = fieldRect();
+	if (fieldHue != h || fieldImage.size() != field.size() * dpr)
+		renderField();
+	if (hueImage.size() != QSize(StripWidth, height()) * dpr)
+		renderHue();
+
+	QPainter p(this);
+	p.fillRect(rect(), palette().window());
+	p.drawImage(field.topLeft(), fieldImage);
+	p.drawImage(hueRect().topLeft(), hueImage);
+
+	if (withAlpha) {
+		const QRect strip = alphaRect();
+		QLinearGradient gradient(strip.topLeft(), strip.bottomLeft());
+		QColor opaque = c;
+		opaque.setAlpha(255);
+		QColor clear = c;
+		clear.setAlpha(0);
+		gradient.setColorAt(0, opaque);
+		gradient.setColorAt(1, clear);
+		p.drawTiledPixmap(strip, QtSwatchCache::checkerboard(dpr));
+		p.fillRect(strip, gradient);
+
+		const int ay = strip.top() + qRound((1 - a) * (strip.height() - 1));
+		p.setPen(Qt::black);
+		p.drawLine(strip.left(), ay, strip.right(), ay);
+	}
+
+	const int hy = qRound(h / 360.0 * (height() - 1));
+	p.setPen(Qt::black);
+	p.drawLine(hueRect().left(), hy, hueRect().right(), hy);
+
+	p.setRenderHint(QPainter::Antialiasing);
+	const QRectF marker = QRectF(markerRect()).adjusted(2, 2, -2, -2);
+	p.setPen(QPen(Qt::white, 2));
+	p.drawEllipse(marker);
+	p.setPen(QPen(Qt::black, 1));
+	p.drawEllipse(marker.adjusted(-1.5, -1.5, 1.5, 1.5));
+}
+
+/*! \internal
+*/
+void QtColorField::mousePressEvent(QMouseEvent *e)
+{
+	dragged = partAt(e->pos());
+	track(e->pos());
+}
+
+/*! \internal
+*/
+void QtColorField::mouseMoveEvent(QMouseEvent *e)
+{
+	if (dragged != NoPart)
+		track(e->pos());
+}
+
+/*! \internal
+*/
+void QtColorField::mouseReleaseEvent(QMouseEvent *e)
+{
+	if (dragged == NoPart)
+		return;
+
+	track(e->pos());
+	dragged = NoPart;
+	emit colorSelected(c);
+}
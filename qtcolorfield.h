@@ -0,0 +1,82 @@
+#ifndef QTCOLORFIELD_H
+#define QTCOLORFIELD_H
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtWidgets/QWidget>
+
+#define QtPublicCtrlDLL
+
+/*
+    An inline color editor: a 2D field, a hue strip and optionally an
+    alpha strip. In Hsv mode the field spans saturation (x) and value
+    (y); in Oklch mode it spans chroma (x) and lightness (y) at the
+    current OKLCH hue.
+
+    The field and strip backgrounds are rendered into cached images,
+    on all cores, and only when the hue, the size or the mode change.
+    Dragging only repaints the area around the old and new markers.
+*/
+class QtPublicCtrlDLL QtColorField : public QWidget
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+
+public:
+    enum Model { Hsv, Oklch };
+
+    QtColorField(QWidget *parent = 0, bool withAlphaChannel = false);
+    ~QtColorField();
+
+    QColor color() const;
+
+    void setModel(Model model);
+    Model model() const;
+
+    void setAlphaEnabled(bool enabled);
+    bool alphaEnabled() const;
+
+    QSize sizeHint() const;
+
+public Q_SLOTS:
+    void setColor(const QColor &color);
+
+Q_SIGNALS:
+    void colorChanged(const QColor &);
+    void colorSelected(const QColor &);
+
+protected:
+    void paintEvent(QPaintEvent *e);
+    void mousePressEvent(QMouseEvent *e);
+    void mouseMoveEvent(QMouseEvent *e);
+    void mouseReleaseEvent(QMouseEvent *e);
+
+private:
+    enum Part { NoPart, FieldPart, HuePart, AlphaPart };
+
+    QRect fieldRect() const;
+    QRect hueRect() const;
+    QRect alphaRect() const;
+    QRect markerRect() const;
+    Part partAt(const QPoint &pos) const;
+    void track(const QPoint &pos);
+    void updateColor();
+
+    void renderField();
+    void renderHue();
+
+    Model m;
+    bool withAlpha;
+    qreal h;
+    qreal fx;
+    qreal fy;
+    qreal a;
+    QColor c;
+    Part dragged;
+
+    QImage fieldImage;
+    qreal fieldHue;
+    QImage hueImage;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include <QtCore/QCoreApplication>
+#include <QtConcurrent/QtConcurrentMap>
+#include <string.h>
+
+#include "qtcolormap.h"
+#include "qtcolorspace.h"
+
+enum { TableSize = 256, TileSize = 64 * 1024 };
+
+// Stops of the presets, evenly spaced. The sequential maps are the
+// matplotlib ones, the diverging ones ColorBrewer's RdBu and
+// Moreland's coolwarm; OKLab interpolation between stops this close
+// stays within a fraction of a unit of the original maps.
+static const QRgb viridisStops[] = {
+	0x440154, 0x482475, 0x414487, 0x355f8d, 0x2a788e, 0x21918c,
+	0x22a884, 0x44bf70, 0x7ad151, 0xbddf26, 0xfde725
+};
+static const QRgb magmaStops[] = {
+	0x000004, 0x140e36, 0x3b0f70, 0x641a80, 0x8c2981, 0xb73779,
+	0xde4968, 0xf7705c, 0xfe9f6d, 0xfecf92, 0xfcfdbf
+};
+static const QRgb infernoStops[] = {
+	0x000004, 0x160b39, 0x420a68, 0x6a176e, 0x932667, 0xbc3754,
+	0xdd513a, 0xf37819, 0xfca50a, 0xf6d746, 0xfcffa4
+};
+static const QRgb plasmaStops[] = {
+	0x0d0887, 0x41049d, 0x6a00a8, 0x8f0da4, 0xb12a90, 0xcc4778,
+	0xe16462, 0xf2844b, 0xfca636, 0xfcce25, 0xf0f921
+};
+static const QRgb cividisStops[] = {
+	0x00204d, 0x00336f, 0x39486b, 0x575c6d, 0x707173, 0x8a8779,
+	0xa69d75, 0xc4b56c, 0xe4cf5b, 0xffea46
+};
+static const QRgb coolwarmStops[] = {
+	0x3b4cc0, 0x8db0fe, 0xdddddd, 0xf49a7b, 0xb40426
+};
+static const QRgb rdBuStops[] = {
+	0x67001f, 0xb2182b, 0xd6604d, 0xf4a582, 0xfddbc7, 0xf7f7f7,
+	0xd1e5f0, 0x92c5de, 0x4393c3, 0x2166ac, 0x053061
+};
+
+struct QtColorMapPreset
+{
+	const char *name;
+	const QRgb *stops;
+	int count;
+};
+
+#define QTCOLORMAP_PRESET(name, stops) { QT_TRANSLATE_NOOP("QtColorMap", name), stops, int(sizeof(stops) / sizeof(stops[0])) }
+
+static const QtColorMapPreset presets[QtColorMap::PresetCount] = {
+	QTCOLORMAP_PRESET("Viridis", viridisStops),
+	QTCOLORMAP_PRESET("Magma", magmaStops),
+	QTCOLORMAP_PRESET("Inferno", infernoStops),
+	QTCOLORMAP_PRESET("Plasma", plasmaStops),
+	QTCOLORMAP_PRESET("Cividis", cividisStops),
+	QTCOLORMAP_PRESET("Coolwarm", coolwarmStops),
+	QTCOLORMAP_PRESET("RdBu", rdBuStops)
+};
+
+/*! \internal
+
+A run of consecutive values mapped by one worker.
+*/
+struct QtSampleTile
+{
+	const float *values;
+	QRgb *colors;
+	int count;
+};
+
+/*! \internal
+
+Maps one tile through the table. The value is scaled to a table
+position, clamped (NaN goes to the start), and the two entries around
+it are blended; the loop has no branches, so it vectorizes.
+*/
+struct QtSampleKernel
+{
+	typedef void result_type;
+
+	const float *red;
+	const float *green;
+	const float *blue;
+	const float *alpha;
+	float minimum;
+	float scale;
+
+	void operator()(const QtSampleTile &tile) const
+	{
+		const float *values = tile.values;
+		QRgb *colors = tile.colors;
+		for (int i = 0; i < tile.count; ++i) {
+			float t = (values[i] - minimum) * scale;
+			t = t > 0 ? t : 0;
+			t = t < TableSize - 1 ? t : TableSize - 1;
+			const int k = int(t);
+			const float f = t - k;
+			const int r = int(red[k] + (red[k + 1] - red[k]) * f + 0.5f);
+			const int g = int(green[k] + (green[k + 1] - green[k]) * f + 0.5f);
+			const int b = int(blue[k] + (blue[k + 1] - blue[k]) * f + 0.5f);
+			const int a = int(alpha[k] + (alpha[k + 1] - alpha[k]) * f + 0.5f);
+			colors[i] = (QRgb(a) << 24) | (QRgb(r) << 16) | (QRgb(g) << 8) | QRgb(b);
+		}
+	}
+};
+
+/*!
+Constructs an empty map; it maps everything to transparent black.
+*/
+QtColorMap::QtColorMap()
+{
+}
+
+/*!
+Constructs a map through \a stops, evenly spaced, called \a name.
+*/
+QtColorMap::QtColorMap(const QList<QColor> &stops, const QString &name)
+	: mapName(name)
+{
+	setStops(stops);
+}
+
+/*!
+Returns the \a preset map, named in the current language.
+*/
+QtColorMap QtColorMap::preset(Preset preset)
+{
+	if (preset < 0 || preset >= PresetCount)
+		return QtColorMap();
+
+	const QtColorMapPreset &source = presets[preset];
+	QList<QColor> stops;
+	for (int i = 0; i < source.count; ++i)
+		stops.append(QColor(source.stops[i]));
+	return QtColorMap(stops, QCoreApplication::translate("QtColorMap", source.name));
+}
+
+/*!
+Sets the colors the map goes through, evenly spaced from 0 to 1, and
+rebuilds the table. A single stop makes a constant map.
+*/
+void QtColorMap::setStops(const QList<QColor> &stops)
+{
+	anchors.clear();
+	for (int i = 0; i < stops.size(); ++i) {
+		if (stops.at(i).isValid())
+			anchors.append(stops.at(i).rgba());
+	}
+
+	red.clear();
+	green.clear();
+	blue.clear();
+	alpha.clear();
+	if (anchors.isEmpty())
+		return;
+
+	// One extra entry, a copy of the last, so that the kernel can
+	// always blend with the next entry.
+	red.resize(TableSize + 1);
+	green.resize(TableSize + 1);
+	blue.resize(TableSize + 1);
+	alpha.resize(TableSize + 1);
+	const int segments = anchors.size() - 1;
+	for (int i = 0; i < TableSize; ++i) {
+		QRgb rgba = anchors.at(0);
+		if (segments > 0) {
+			const float t = float(i) * segments / (TableSize - 1);
+			const int s = qMin(int(t), segments - 1);
+			rgba = QtColorSpace::mixOklab(anchors.at(s), anchors.at(s + 1), t - s);
+		}
+		red[i] = qRed(rgba);
+		green[i] = qGreen(rgba);
+		blue[i] = qBlue(rgba);
+		alpha[i] = qAlpha(rgba);
+	}
+	red[TableSize] = red[TableSize - 1];
+	green[TableSize] = green[TableSize - 1];
+	blue[TableSize] = blue[TableSize - 1];
+	alpha[TableSize] = alpha[TableSize - 1];
+}
+
+/*!
+Returns the colors the map goes through.
+*/
+QList<QColor> QtColorMap::stops() const
+{
+	QList<QColor> stops;
+	for (int i = 0; i < anchors.size(); ++i)
+		stops.append(QColor::fromRgba(anchors.at(i)));
+	return stops;
+}
+
+/*!
+Returns true if the map has no stops.
+*/
+bool QtColorMap::isEmpty() const
+{
+	return anchors.isEmpty();
+}
+
+/*!
+
+*/
+void QtColorMap::setName(const QString &name)
+{
+	mapName = name;
+}
+
+/*!
+
+*/
+QString QtColorMap::name() const
+{
+	return mapName;
+}
+
+/*!
+Returns \a count colors sampled evenly from 0 to 1, to show the map
+as a palette.
+*/
+QList<QColor> QtColorMap::colors(int count) const
+{
+	QList<QColor> colors;
+	for (int i = 0; i < count; ++i)
+		colors.append(QColor::fromRgba(map(count > 1 ? float(i) / (count - 1) : 0.5f)));
+	return colors;
+}
+
+/*!
+Returns the color of \a value, with \a minimum and \a maximum mapped
+to the ends of the map. Values outside the range are clamped.
+*/
+QRgb QtColorMap::map(float value, float minimum, float maximum) const
+{
+	QRgb rgba = 0;
+	map(&value, &rgba, 1, minimum, maximum);
+	return rgba;
+}
+
+/*!
+Maps \a count \a values to \a colors, as map() does for one value.
+Large arrays are cut into tiles processed in parallel.
+*/
+void QtColorMap::map(const float *values, QRgb *colors, int count, float minimum, float maximum) const
+{
+	if (anchors.isEmpty()) {
+		memset(colors, 0, count * sizeof(QRgb));
+		return;
+	}
+
+	QtSampleKernel kernel;
+	kernel.red = red.constData();
+	kernel.green = green.constData();
+	kernel.blue = blue.constData();
+	kernel.alpha = alpha.constData();
+	kernel.minimum = minimum;
+	kernel.scale = maximum != minimum ? (TableSize - 1) / (maximum - minimum) : 0;
+
+	if (count <= TileSize) {
+		const QtSampleTile tile = { values, colors, count };
+		kernel(tile);
+		return;
+	}
+
+	QVector<QtSampleTile> tiles;
+	for (int i = 0; i < count; i += TileSize) {
+		QtSampleTile tile;
+		tile.values = values + i;
+		tile.colors = colors + i;
+		tile.count = qMin(int(TileSize), count - i);
+		tiles.append(tile);
+	}
+	QtConcurrent::blockingMap(tiles, kernel);
+}
@@ -0,0 +1,63 @@
+#ifndef QTCOLORMAP_H
+#define QTCOLORMAP_H
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+
+#define QtPublicCtrlDLL
+
+/*
+    A continuous colormap: evenly spaced stops, interpolated in OKLab
+    into a 256 entry table when the stops are set. Sampling a value is
+    a table lookup and a linear blend of two entries, so arrays of
+    millions of values are mapped in a few milliseconds, split across
+    all cores. The class is reentrant: a map can be copied to worker
+    threads and sampled concurrently.
+
+    The presets are the perceptually uniform maps of matplotlib and
+    ColorBrewer: sequential viridis, magma, inferno, plasma and
+    cividis, and diverging coolwarm and RdBu.
+*/
+class QtPublicCtrlDLL QtColorMap
+{
+public:
+    enum Preset
+    {
+        Viridis,
+        Magma,
+        Inferno,
+        Plasma,
+        Cividis,
+        Coolwarm,
+        RdBu,
+        PresetCount
+    };
+
+    QtColorMap();
+    explicit QtColorMap(const QList<QColor> &stops, const QString &name = QString());
+
+    static QtColorMap preset(Preset preset);
+
+    void setStops(const QList<QColor> &stops);
+    QList<QColor> stops() const;
+    bool isEmpty() const;
+
+    void setName(const QString &name);
+    QString name() const;
+
+    QList<QColor> colors(int count) const;
+
+    QRgb map(float value, float minimum = 0, float maximum = 1) const;
+    void map(const float *values, QRgb *colors, int count, float minimum = 0, float maximum = 1) const;
+
+private:
+    QString mapName;
+    QVector<QRgb> anchors;
+    QVector<float> red;
+    QVector<float> green;
+    QVector<float> blue;
+    QVector<float> alpha;
+};
+
+#endif
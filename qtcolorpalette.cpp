@@ -0,0 +1,600 @@
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/qmath.h>
+#include <algorithm>
+#include <float.h>
+
+#include "qtcolorpalette.h"
+
+enum { CustomEntry = 0x01, MaxEntries = 0xffffff };
+
+// Colors with less OKLCH chroma than this are sorted as grays.
+static const float GrayChroma = 0.02f;
+
+/*! \internal
+
+Orders palette indices by a precomputed key, keeping the palette
+order between equal keys.
+*/
+struct QtSortIndex
+{
+	float primary;
+	float secondary;
+	int index;
+};
+
+static bool lessByKeys(const QtSortIndex &i1, const QtSortIndex &i2)
+{
+	if (i1.primary != i2.primary)
+		return i1.primary < i2.primary;
+	return i1.secondary < i2.secondary;
+}
+
+/*! \internal
+
+Orders palette indices by the locale aware comparison of their names.
+*/
+struct QtNameLess
+{
+	const QStringList *names;
+
+	bool operator()(int i1, int i2) const
+	{
+		return QString::localeAwareCompare(names->at(i1), names->at(i2)) < 0;
+	}
+};
+
+/*!
+Constructs an empty palette that only folds exact duplicates.
+*/
+QtColorPalette::QtColorPalette()
+	: deltaE(0), ver(0), remapperVersion(-1)
+{
+}
+
+/*!
+Constructs a snapshot of \a other.
+*/
+QtColorPalette::QtColorPalette(const QtColorPalette &other)
+	: remapperVersion(-1)
+{
+	QReadLocker locker(&other.lock);
+	entries = other.entries;
+	exact = other.exact;
+	cells = other.cells;
+	deltaE = other.deltaE;
+	ver = other.ver;
+}
+
+/*!
+Replaces the palette with a snapshot of \a other.
+*/
+QtColorPalette &QtColorPalette::operator=(const QtColorPalette &other)
+{
+	if (&other == this)
+		return *this;
+
+	// Copied before locking this palette, so that two palettes
+	// assigned to each other from two threads cannot deadlock.
+	QtColorPalette copy(other);
+	QWriteLocker locker(&lock);
+	entries.swap(copy.entries);
+	exact.swap(copy.exact);
+	cells.swap(copy.cells);
+	deltaE = copy.deltaE;
+	++ver;
+	return *this;
+}
+
+/*!
+Destructs the palette.
+*/
+QtColorPalette::~QtColorPalette()
+{
+}
+
+/*!
+Returns the number of entries.
+*/
+int QtColorPalette::count() const
+{
+	QReadLocker locker(&lock);
+	return entries.size();
+}
+
+/*!
+Returns true if the palette has no entries.
+*/
+bool QtColorPalette::isEmpty() const
+{
+	QReadLocker locker(&lock);
+	return entries.isEmpty();
+}
+
+/*!
+Returns a number that changes whenever the entries do, to invalidate
+what views and workers derive from them.
+*/
+int QtColorPalette::version() const
+{
+	QReadLocker locker(&lock);
+	return ver;
+}
+
+/*!
+Returns the color of entry \a index, or an invalid color if there is
+no such entry.
+*/
+QColor QtColorPalette::color(int index) const
+{
+	QReadLocker locker(&lock);
+	if (index < 0 || index >= entries.size())
+		return QColor();
+	return QColor::fromRgba(entries.at(index).rgba);
+}
+
+/*!
+Returns the name of entry \a index. Names inserted from a
+QtPaletteTable are translated here, in the table's context.
+*/
+QString QtColorPalette::name(int index) const
+{
+	QReadLocker locker(&lock);
+	if (index < 0 || index >= entries.size())
+		return QString();
+	return entryName(entries.at(index));
+}
+
+/*!
+Returns true if entry \a index was picked by the user rather than
+being part of the palette.
+*/
+bool QtColorPalette::isCustom(int index) const
+{
+	QReadLocker locker(&lock);
+	return index >= 0 && index < entries.size() && entries.at(index).custom;
+}
+
+/*!
+Returns the ARGB values of all the entries, in order.
+*/
+QVector<QRgb> QtColorPalette::colors() const
+{
+	QReadLocker locker(&lock);
+	QVector<QRgb> result(entries.size());
+	for (int i = 0; i < entries.size(); ++i)
+		result[i] = entries.at(i).rgba;
+	return result;
+}
+
+/*!
+Inserts \a color named \a name at \a index, or at the end if \a index
+is -1. Returns the index of the new entry, or -1 if \a color is
+invalid or within tolerance() of an existing entry.
+*/
+int QtColorPalette::insert(const QColor &color, const QString &name, int index, bool custom)
+{
+	if (!color.isValid())
+		return -1;
+
+	QWriteLocker locker(&lock);
+	if (findSimilar(color) != -1)
+		return -1;
+
+	const Entry entry = makeEntry(color.rgba(), name, custom);
+	if (index < 0 || index >= entries.size()) {
+		index = entries.size();
+		appendEntry(entry);
+	} else {
+		entries.insert(index, entry);
+		reindex();
+	}
+	++ver;
+	return index;
+}
+
+/*!
+Appends the colors of \a table that are not already in the palette,
+keeping their names untranslated until they are asked for. Returns
+the number of entries added.
+*/
+int QtColorPalette::insert(const QtPaletteTable &table)
+{
+	QWriteLocker locker(&lock);
+	int inserted = 0;
+	for (int i = 0; i < table.count; ++i) {
+		const QtPaletteEntry &source = table.entries[i];
+		if (findSimilar(QColor::fromRgba(source.rgba)) != -1)
+			continue;
+
+		Entry entry = makeEntry(source.rgba, QString(), false);
+		entry.context = table.context;
+		entry.key = source.key;
+		appendEntry(entry);
+		++inserted;
+	}
+	if (inserted)
+		++ver;
+	return inserted;
+}
+
+/*!
+Appends \a color named \a name, even if the palette already has a
+similar entry. Views use it to mirror palettes that hold duplicates.
+*/
+void QtColorPalette::append(const QColor &color, const QString &name, bool custom)
+{
+	if (!color.isValid())
+		return;
+
+	QWriteLocker locker(&lock);
+	appendEntry(makeEntry(color.rgba(), name, custom));
+	++ver;
+}
+
+/*!
+Appends \a color, named \a key translated in \a context when the name
+is asked for, even if the palette already has a similar entry. Views
+use it to mirror entries inserted from a QtPaletteTable.
+*/
+void QtColorPalette::appendTranslatable(const QColor &color, const char *context, const char *key, bool custom)
+{
+	if (!color.isValid())
+		return;
+
+	Entry entry = makeEntry(color.rgba(), QString(), custom);
+	entry.context = context;
+	entry.key = key;
+
+	QWriteLocker locker(&lock);
+	appendEntry(entry);
+	++ver;
+}
+
+/*!
+Removes entry \a index.
+*/
+void QtColorPalette::remove(int index)
+{
+	QWriteLocker locker(&lock);
+	if (index < 0 || index >= entries.size())
+		return;
+
+	entries.remove(index);
+	reindex();
+	++ver;
+}
+
+/*!
+Removes all the entries.
+*/
+void QtColorPalette::clear()
+{
+	QWriteLocker locker(&lock);
+	entries.clear();
+	exact.clear();
+	cells.clear();
+	++ver;
+}
+
+/*!
+Sets whether entry \a index is a custom color.
+*/
+void QtColorPalette::setCustom(int index, bool custom)
+{
+	QWriteLocker locker(&lock);
+	if (index >= 0 && index < entries.size())
+		entries[index].custom = custom;
+}
+
+/*!
+Colors closer than \a deltaE (CIE76) to an existing entry are folded
+into it instead of being inserted. 0 only rejects exact duplicates.
+*/
+void QtColorPalette::setTolerance(qreal deltaE)
+{
+	QWriteLocker locker(&lock);
+	this->deltaE = qMax(qreal(0), deltaE);
+	reindex();
+}
+
+qreal QtColorPalette::tolerance() const
+{
+	QReadLocker locker(&lock);
+	return deltaE;
+}
+
+/*!
+Returns the index of the first entry whose ARGB value is the one of
+\a color, or -1.
+*/
+int QtColorPalette::indexOf(const QColor &color) const
+{
+	if (!color.isValid())
+		return -1;
+
+	QReadLocker locker(&lock);
+	return exact.value(color.rgba(), -1);
+}
+
+/*!
+Returns the index of the entry closest to \a color within
+tolerance(), or -1. Differences in alpha count as much as the same
+fraction of lightness. An entry exactly at the tolerance matches; of
+equally close entries, the first one wins.
+*/
+int QtColorPalette::indexOfSimilar(const QColor &color) const
+{
+	QReadLocker locker(&lock);
+	return findSimilar(color);
+}
+
+/*!
+Returns the index of the entry closest to \a rgb in OKLab, ignoring
+alpha, or -1 if the palette is empty. Unlike remapper(), the match is
+exact; use the remapper for whole images.
+*/
+int QtColorPalette::nearest(QRgb rgb) const
+{
+	const QtLabColor lab = QtColorSpace::toOklab(rgb);
+
+	QReadLocker locker(&lock);
+	int best = -1;
+	float bestDistance = FLT_MAX;
+	for (int i = 0; i < entries.size(); ++i) {
+		const QtLabColor &ok = entries.at(i).oklab;
+		const float dl = ok.l - lab.l;
+		const float da = ok.a - lab.a;
+		const float db = ok.b - lab.b;
+		const float d = dl * dl + da * da + db * db;
+		if (d < bestDistance) {
+			best = i;
+			bestDistance = d;
+		}
+	}
+	return best;
+}
+
+/*!
+Returns a remapper for the entries. Its lookup table is only rebuilt
+when the entries changed since the last call.
+*/
+QtPaletteRemapper QtColorPalette::remapper() const
+{
+	QReadLocker locker(&lock);
+	QMutexLocker cacheLocker(&remapperMutex);
+	if (remapperVersion != ver) {
+		QList<QColor> palette;
+		palette.reserve(entries.size());
+		for (int i = 0; i < entries.size(); ++i)
+			palette.append(QColor::fromRgba(entries.at(i).rgba));
+		cachedRemapper.setPalette(palette);
+		remapperVersion = ver;
+	}
+	return cachedRemapper;
+}
+
+/*!
+Sorts the entries by \a key, in OKLCH for the color keys; grays come
+first when sorting by hue. The sort is stable. Returns the previous
+index of each entry, in the new order, for views to follow.
+*/
+QVector<int> QtColorPalette::sort(SortKey key)
+{
+	QWriteLocker locker(&lock);
+	const int count = entries.size();
+	QVector<int> order(count);
+
+	if (key == ByName) {
+		QStringList names;
+		names.reserve(count);
+		for (int i = 0; i < count; ++i) {
+			names.append(entryName(entries.at(i)));
+			order[i] = i;
+		}
+		QtNameLess less = { &names };
+		std::stable_sort(order.begin(), order.end(), less);
+	} else {
+		QVector<QtSortIndex> keys(count);
+		for (int i = 0; i < count; ++i) {
+			const QtLabColor &ok = entries.at(i).oklab;
+			const float chroma = sqrtf(ok.a * ok.a + ok.b * ok.b);
+			QtSortIndex &k = keys[i];
+			k.index = i;
+			if (key == ByLightness) {
+				k.primary = ok.l;
+				k.secondary = chroma;
+			} else if (key == ByChroma) {
+				k.primary = chroma;
+				k.secondary = ok.l;
+			} else if (chroma < GrayChroma) {
+				k.primary = -1;
+				k.secondary = ok.l;
+			} else {
+				const float hue = atan2f(ok.b, ok.a);
+				k.primary = hue < 0 ? hue + 2 * float(M_PI) : hue;
+				k.secondary = ok.l;
+			}
+		}
+		std::stable_sort(keys.begin(), keys.end(), lessByKeys);
+		for (int i = 0; i < count; ++i)
+			order[i] = keys.at(i).index;
+	}
+
+	QVector<Entry> sorted(count);
+	bool moved = false;
+	for (int i = 0; i < count; ++i) {
+		sorted[i] = entries.at(order.at(i));
+		moved = moved || order.at(i) != i;
+	}
+	if (moved) {
+		entries.swap(sorted);
+		reindex();
+		++ver;
+	}
+	return order;
+}
+
+/*!
+Writes the entries to \a stream: their count, then the ARGB value,
+flags and UTF-8 name of each.
+*/
+void QtColorPalette::save(QDataStream &stream) const
+{
+	QReadLocker locker(&lock);
+	stream << quint32(entries.size());
+	for (int i = 0; i < entries.size(); ++i) {
+		const Entry &entry = entries.at(i);
+		stream << quint32(entry.rgba) << quint8(entry.custom ? CustomEntry : 0)
+			<< entryName(entry).toUtf8();
+	}
+}
+
+/*!
+Replaces the entries with the ones read from \a stream, as written by
+save(). The whole stream is read and checked first; returns false,
+leaving the palette untouched, if it is truncated or corrupt.
+*/
+bool QtColorPalette::load(QDataStream &stream)
+{
+	quint32 count = 0;
+	stream >> count;
+	if (stream.status() != QDataStream::Ok || count > MaxEntries)
+		return false;
+
+	// The count is not trusted: a corrupt header must not reserve
+	// more than the entries actually read.
+	QVector<Entry> loaded;
+	loaded.reserve(int(qMin(count, quint32(4096))));
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+		quint32 rgba = 0;
+		quint8 flags = 0;
+		QByteArray name;
+		stream >> rgba >> flags >> name;
+		loaded.append(makeEntry(rgba, QString::fromUtf8(name), (flags & CustomEntry) != 0));
+	}
+	if (stream.status() != QDataStream::Ok)
+		return false;
+
+	QWriteLocker locker(&lock);
+	entries.swap(loaded);
+	reindex();
+	++ver;
+	return true;
+}
+
+/*! \internal
+
+*/
+QtColorPalette::Entry QtColorPalette::makeEntry(QRgb rgba, const QString &name, bool custom)
+{
+	Entry entry;
+	entry.rgba = rgba;
+	entry.name = name;
+	entry.context = 0;
+	entry.key = 0;
+	entry.custom = custom;
+	entry.lab = QtColorSpace::toLab(rgba);
+	entry.oklab = QtColorSpace::toOklab(rgba);
+	return entry;
+}
+
+/*! \internal
+
+*/
+QString QtColorPalette::entryName(const Entry &entry)
+{
+	return entry.key ? QCoreApplication::translate(entry.context, entry.key) : entry.name;
+}
+
+/*! \internal
+
+Returns the index of the entry closest to \a color within the
+tolerance, looking only at the 27 spatial hash cells around it. The
+caller holds the lock.
+
+The tolerance is inclusive, as it was when the popup did the lookup.
+Ties go to the lowest index rather than to whichever candidate the
+hash happened to visit last.
+*/
+int QtColorPalette::findSimilar(const QColor &color) const
+{
+	if (!color.isValid())
+		return -1;
+	if (deltaE <= 0)
+		return exact.value(color.rgba(), -1);
+
+	const QtLabColor lab = QtColorSpace::toLab(color.rgb());
+	int best = -1;
+	float bestDistance = float(deltaE);
+
+	for (int dl = -1; dl <= 1; ++dl) {
+		for (int da = -1; da <= 1; ++da) {
+			for (int db = -1; db <= 1; ++db) {
+				const quint64 key = cell(lab, dl, da, db);
+				QMultiHash<quint64, int>::const_iterator it = cells.constFind(key);
+				for (; it != cells.constEnd() && it.key() == key; ++it) {
+					const Entry &entry = entries.at(it.value());
+					const float dAlpha = (qAlpha(entry.rgba) - color.alpha()) * (100.0f / 255.0f);
+					const float dE = QtColorSpace::deltaE(lab, entry.lab);
+					const float distance = sqrtf(dE * dE + dAlpha * dAlpha);
+					if (distance > bestDistance)
+						continue;
+					if (best == -1 || distance < bestDistance || it.value() < best) {
+						best = it.value();
+						bestDistance = distance;
+					}
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+/*! \internal
+
+Returns the key of the spatial hash cell holding \a lab, offset by
+(\a dl, \a da, \a db) cells.
+*/
+quint64 QtColorPalette::cell(const QtLabColor &lab, int dl, int da, int db) const
+{
+	const float size = float(deltaE);
+	const quint64 l = quint64(qint64(floorf(lab.l / size)) + dl + (1 << 20)) & 0x1fffff;
+	const quint64 a = quint64(qint64(floorf(lab.a / size)) + da + (1 << 20)) & 0x1fffff;
+	const quint64 b = quint64(qint64(floorf(lab.b / size)) + db + (1 << 20)) & 0x1fffff;
+	return (l << 42) | (a << 21) | b;
+}
+
+/*! \internal
+
+Appends \a entry and indexes it. The caller holds the write lock.
+*/
+void QtColorPalette::appendEntry(const Entry &entry)
+{
+	const int index = entries.size();
+	entries.append(entry);
+	if (!exact.contains(entry.rgba))
+		exact.insert(entry.rgba, index);
+	if (deltaE > 0)
+		cells.insert(cell(entry.lab), index);
+}
+
+/*! \internal
+
+Rebuilds both indexes after entries moved. The caller holds the
+write lock.
+*/
+void QtColorPalette::reindex()
+{
+	exact.clear();
+	cells.clear();
+	exact.reserve(entries.size());
+	for (int i = 0; i < entries.size(); ++i) {
+		const Entry &entry = entries.at(i);
+		if (!exact.contains(entry.rgba))
+			exact.insert(entry.rgba, i);
+		if (deltaE > 0)
+			cells.insert(cell(entry.lab), i);
+	}
+}
@@ -0,0 +1,105 @@
+#ifndef QTCOLORPALETTE_H
+#define QTCOLORPALETTE_H
+#include <QtCore/QDataStream>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+
+#include "qtcolorspace.h"
+#include "qtpaletteremapper.h"
+#include "qtpalettetable.h"
+
+#define QtPublicCtrlDLL
+
+/*
+    The palette behind a QtColorPicker, without any widget: ordered
+    entries with their names and custom flags, exact and tolerant
+    lookup, nearest match, sorting and the binary format of
+    QtColorPicker::saveState().
+
+    Only QtCore and QtGui are used, so the class works in headless
+    processes and worker threads. Every member is thread safe: reads
+    share a lock and run concurrently, writes are exclusive. Copies
+    are snapshots, cheap to hand over to a worker.
+*/
+class QtPublicCtrlDLL QtColorPalette
+{
+public:
+    enum SortKey
+    {
+        ByLightness,
+        ByHue,
+        ByChroma,
+        ByName
+    };
+
+    QtColorPalette();
+    QtColorPalette(const QtColorPalette &other);
+    QtColorPalette &operator=(const QtColorPalette &other);
+    ~QtColorPalette();
+
+    int count() const;
+    bool isEmpty() const;
+    int version() const;
+
+    QColor color(int index) const;
+    QString name(int index) const;
+    bool isCustom(int index) const;
+    QVector<QRgb> colors() const;
+
+    int insert(const QColor &color, const QString &name, int index = -1, bool custom = false);
+    int insert(const QtPaletteTable &table);
+    void append(const QColor &color, const QString &name, bool custom = false);
+    void appendTranslatable(const QColor &color, const char *context, const char *key, bool custom = false);
+    void remove(int index);
+    void clear();
+    void setCustom(int index, bool custom);
+
+    void setTolerance(qreal deltaE);
+    qreal tolerance() const;
+
+    int indexOf(const QColor &color) const;
+    int indexOfSimilar(const QColor &color) const;
+    int nearest(QRgb rgb) const;
+    QtPaletteRemapper remapper() const;
+
+    QVector<int> sort(SortKey key);
+
+    void save(QDataStream &stream) const;
+    bool load(QDataStream &stream);
+
+private:
+    struct Entry
+    {
+        QRgb rgba;
+        QString name;
+        const char *context;
+        const char *key;
+        bool custom;
+        QtLabColor lab;
+        QtLabColor oklab;
+    };
+
+    static Entry makeEntry(QRgb rgba, const QString &name, bool custom);
+    static QString entryName(const Entry &entry);
+    int findSimilar(const QColor &color) const;
+    quint64 cell(const QtLabColor &lab, int dl = 0, int da = 0, int db = 0) const;
+    void appendEntry(const Entry &entry);
+    void reindex();
+
+    mutable QReadWriteLock lock;
+    QVector<Entry> entries;
+    QHash<QRgb, int> exact;
+    QMultiHash<quint64, int> cells;
+    qreal deltaE;
+    int ver;
+
+    mutable QMutex remapperMutex;
+    mutable QtPaletteRemapper cachedRemapper;
+    mutable int remapperVersion;
+};
+
+#endif
@@ -0,0 +1,255 @@
+#include <math.h>
+
+#include "qtcolorparser.h"
+
+enum { MaxNameLength = 32 };
+
+static inline bool isSpace(ushort c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool isLetter(ushort c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline int hexValue(ushort c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static inline int toByte(float value)
+{
+	return qBound(0, int(value + 0.5f), 255);
+}
+
+/*! \internal
+
+Parses the \a length hex digits at \a p, as in #rgb, #rgba, #rrggbb
+or #rrggbbaa.
+*/
+static bool parseHex(const QChar *p, int length, QRgb *rgba)
+{
+	if (length != 3 && length != 4 && length != 6 && length != 8)
+		return false;
+
+	int digits[8];
+	for (int i = 0; i < length; ++i) {
+		digits[i] = hexValue(p[i].unicode());
+		if (digits[i] < 0)
+			return false;
+	}
+
+	if (length <= 4)
+		*rgba = qRgba(digits[0] * 17, digits[1] * 17, digits[2] * 17, length == 4 ? digits[3] * 17 : 255);
+	else
+		*rgba = qRgba(digits[0] * 16 + digits[1], digits[2] * 16 + digits[3], digits[4] * 16 + digits[5],
+			length == 8 ? digits[6] * 16 + digits[7] : 255);
+	return true;
+}
+
+/*! \internal
+
+Reads a CSS number at \a p, followed by an optional '%', which sets
+\a percent, or a unit such as "deg", which is skipped.
+*/
+static bool parseNumber(const QChar *&p, const QChar *end, float *value, bool *percent)
+{
+	float sign = 1;
+	if (p < end && (*p == QLatin1Char('-') || *p == QLatin1Char('+'))) {
+		if (*p == QLatin1Char('-'))
+			sign = -1;
+		++p;
+	}
+
+	float v = 0;
+	int digits = 0;
+	while (p < end && p->unicode() >= '0' && p->unicode() <= '9') {
+		v = v * 10 + (p->unicode() - '0');
+		++p;
+		++digits;
+	}
+	if (p < end && *p == QLatin1Char('.')) {
+		++p;
+		float scale = 0.1f;
+		while (p < end && p->unicode() >= '0' && p->unicode() <= '9') {
+			v += scale * (p->unicode() - '0');
+			scale *= 0.1f;
+			++p;
+			++digits;
+		}
+	}
+	if (!digits)
+		return false;
+
+	*value = sign * v;
+	*percent = p < end && *p == QLatin1Char('%');
+	if (*percent)
+		++p;
+	else while (p < end && isLetter(p->unicode()))
+		++p;
+	return true;
+}
+
+/*! \internal
+
+Parses the arguments of rgb(), rgba(), hsl() or hsla(), starting
+after the opening parenthesis. Both the comma and the space separated
+syntaxes are accepted, with an optional alpha after ',' or '/'.
+*/
+static bool parseFunction(const QChar *p, const QChar *end, bool hsl, QRgb *rgba)
+{
+	float v[4];
+	bool percent[4];
+	int count = 0;
+	for (;;) {
+		while (p < end && isSpace(p->unicode()))
+			++p;
+		if (p < end && *p == QLatin1Char(')')) {
+			++p;
+			break;
+		}
+		if (count == 4 || !parseNumber(p, end, &v[count], &percent[count]))
+			return false;
+		++count;
+		while (p < end && isSpace(p->unicode()))
+			++p;
+		if (p < end && (*p == QLatin1Char(',') || *p == QLatin1Char('/')))
+			++p;
+	}
+	if (p != end || count < 3)
+		return false;
+
+	const int alpha = count == 4 ? toByte((percent[3] ? v[3] / 100 : v[3]) * 255) : 255;
+	if (hsl) {
+		float hue = fmodf(v[0], 360.0f);
+		if (hue < 0)
+			hue += 360.0f;
+		const QColor color = QColor::fromHslF(hue / 360.0f, qBound(0.0f, v[1] / 100, 1.0f), qBound(0.0f, v[2] / 100, 1.0f));
+		*rgba = qRgba(color.red(), color.green(), color.blue(), alpha);
+	} else {
+		int c[3];
+		for (int i = 0; i < 3; ++i)
+			c[i] = toByte(percent[i] ? v[i] * 2.55f : v[i]);
+		*rgba = qRgba(c[0], c[1], c[2], alpha);
+	}
+	return true;
+}
+
+/*! \internal
+
+Returns true if the function name at [\a p, \a end) is \a name,
+ignoring case.
+*/
+static bool isName(const QChar *p, const QChar *end, const char *name)
+{
+	for (; p < end && *name; ++p, ++name) {
+		ushort c = p->unicode();
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		if (c != ushort(*name))
+			return false;
+	}
+	return p == end && !*name;
+}
+
+/*!
+Parses the color spelled by the \a length characters at \a text into
+\a rgba. Leading and trailing spaces are ignored. Returns false if
+the text is not a color.
+*/
+bool QtColorParser::parse(const QChar *text, int length, QRgb *rgba)
+{
+	const QChar *p = text;
+	const QChar *end = text + length;
+	while (p < end && isSpace(p->unicode()))
+		++p;
+	while (end > p && isSpace(end[-1].unicode()))
+		--end;
+	if (p == end)
+		return false;
+
+	if (*p == QLatin1Char('#'))
+		return parseHex(p + 1, int(end - p - 1), rgba);
+
+	const QChar *q = p;
+	while (q < end && isLetter(q->unicode()))
+		++q;
+
+	if (q < end && *q == QLatin1Char('(')) {
+		if (isName(p, q, "rgb") || isName(p, q, "rgba"))
+			return parseFunction(q + 1, end, false, rgba);
+		if (isName(p, q, "hsl") || isName(p, q, "hsla"))
+			return parseFunction(q + 1, end, true, rgba);
+		return false;
+	}
+
+	if ((end - p == 6 || end - p == 8) && parseHex(p, int(end - p), rgba))
+		return true;
+
+	// Named colors are looked up from a Latin-1 copy on the stack.
+	if (q != end || end - p > MaxNameLength)
+		return false;
+	char name[MaxNameLength];
+	const int n = int(end - p);
+	for (int i = 0; i < n; ++i)
+		name[i] = char(p[i].unicode());
+
+	QColor color;
+	color.setNamedColor(QLatin1String(name, n));
+	if (!color.isValid())
+		return false;
+	*rgba = color.rgba();
+	return true;
+}
+
+/*!
+Returns the color spelled by \a text, or an invalid color.
+*/
+QColor QtColorParser::parse(const QString &text)
+{
+	QRgb rgba;
+	return parse(text.constData(), text.size(), &rgba) ? QColor::fromRgba(rgba) : QColor();
+}
+
+/*!
+Appends to \a colors the colors of the list in \a text and returns
+how many were found. Entries are separated by spaces, line breaks,
+commas or semicolons outside parentheses; entries that are not
+colors are skipped.
+*/
+int QtColorParser::parseList(const QString &text, QVector<QRgb> *colors)
+{
+	const int before = colors->size();
+	const QChar *p = text.constData();
+	const QChar *end = p + text.size();
+	colors->reserve(before + text.size() / 8);
+
+	while (p < end) {
+		const QChar *token = p;
+		int depth = 0;
+		for (; p < end; ++p) {
+			const ushort c = p->unicode();
+			if (c == '(')
+				++depth;
+			else if (c == ')' && depth > 0)
+				--depth;
+			else if (!depth && (isSpace(c) || c == ',' || c == ';'))
+				break;
+		}
+
+		QRgb rgba;
+		if (p > token && parse(token, int(p - token), &rgba))
+			colors->append(rgba);
+		if (p < end)
+			++p;
+	}
+	return colors->size() - before;
+}
@@ -0,0 +1,27 @@
+#ifndef QTCOLORPARSER_H
+#define QTCOLORPARSER_H
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+
+#define QtPublicCtrlDLL
+
+/*
+    Parses colors written the way they are in CSS and design tools:
+    #rgb, #rgba, #rrggbb and #rrggbbaa (alpha last, unlike QColor),
+    bare rrggbb and rrggbbaa, rgb(), rgba(), hsl(), hsla() and the
+    SVG color names.
+
+    The parser works in place on the text: no token is copied, so
+    splitting and parsing a long pasted list does not allocate
+    anything but the output vector.
+*/
+class QtPublicCtrlDLL QtColorParser
+{
+public:
+    static bool parse(const QChar *text, int length, QRgb *rgba);
+    static QColor parse(const QString &text);
+    static int parseList(const QString &text, QVector<QRgb> *colors);
+};
+
+#endif
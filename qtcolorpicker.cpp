@@ -49,6 +49,7 @@
 // - add stylesheet to the button to use the current color
 
 #include <QtWidgets/QApplication>
+#include <QtGui/QClipboard>
 #include <QtWidgets/QDesktopWidget>
 #include <QtGui\QPainter>
 #include <QtWidgets/QPushButton>
@@ -57,10 +58,30 @@
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QToolTip>
 #include <QtGui/QFocusEvent>
+#include <QtGui/QScreen>
+#include <QtGui/QWindow>
+#include <QtCore/QVector>
 #include <math.h>
 
 #include "qtcolorpicker.h"
 
+enum {
+	StateMagic = 0x51435053, // "QCPS"
+	StateVersion = 1,
+
+	DialogOption = 0x01,
+	SharedRecentOption = 0x02,
+	FirstInsertedOption = 0x04,
+
+	AlphaOption = 0x01,
+	SelectionOption = 0x02,
+
+	MinEntrySize = 4 + 1 + 4, // ARGB, flags, empty name
+
+	DerivedSteps = 8,
+	MaxCachedRamps = 1024
+};
+
 /*! \class QtColorPicker
 
 \brief The QtColorPicker class provides a widget for selecting
@@ -127,6 +148,18 @@ This signal is emitted when the QtColorPicker's color is changed.
 To obtain the color's name, use text().
 */
 
+/*! \fn QtColorPicker::colorPreviewed(const QColor &color)
+
+This signal is emitted while the user browses the popup grid with the
+mouse or the arrow keys, with the \a color under the cursor or the
+focus. Emissions are coalesced to at most one per display frame, and
+only the last color of a frame is reported.
+
+When the popup closes after a preview, the signal is emitted once
+more with currentColor(): the picked color if the user selected one,
+the previous color if they cancelled.
+*/
+
 /*!
 Constructs a QtColorPicker widget. The popup will display a grid
 with \a cols columns, or if \a cols is -1, the number of columns
@@ -146,7 +179,7 @@ The \a parent argument is passed to QFrame's constructor.
 */
 QtColorPicker::QtColorPicker(QWidget *parent,
 							 int cols, bool enableColorDialog)
-							 : QPushButton(parent), popup(0), withColorDialog(enableColorDialog)
+							 : QPushButton(parent), popup(0), paletteSource(0), mapRevision(-1), withColorDialog(enableColorDialog)
 {
 	setFocusPolicy(Qt::StrongFocus);
 	setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
@@ -167,6 +200,8 @@ QtColorPicker::QtColorPicker(QWidget *parent,
 	connect(popup, SIGNAL(selected(const QColor &)),
 		SLOT(setCurrentColor(const QColor &)));
 	connect(popup, SIGNAL(hid()), SLOT(popupClosed()));
+	connect(popup, SIGNAL(previewed(const QColor &)), SIGNAL(colorPreviewed(const QColor &)));
+	connect(popup, SIGNAL(previewEnded()), SLOT(previewEnded()));
 
 	// Connect this push button's pressed() signal.
 	connect(this, SIGNAL(toggled(bool)), SLOT(buttonPressed(bool)));
@@ -181,6 +216,42 @@ QtColorPicker::~QtColorPicker()
 
 /*! \internal
 
+Available geometry of each screen, by screen number. It is shared by
+all the pickers and dropped whenever a screen is added, removed or
+resized, or its work area changes.
+*/
+static QHash<int, QRect> &screenGeometryCache()
+{
+	static QHash<int, QRect> cache;
+	return cache;
+}
+
+static void clearScreenGeometryCache()
+{
+	screenGeometryCache().clear();
+}
+
+static QRect availableScreenGeometry(const QWidget *widget)
+{
+	QDesktopWidget *desktop = QApplication::desktop();
+	static bool connected = false;
+	if (!connected) {
+		QObject::connect(desktop, &QDesktopWidget::resized, clearScreenGeometryCache);
+		QObject::connect(desktop, &QDesktopWidget::workAreaResized, clearScreenGeometryCache);
+		QObject::connect(desktop, &QDesktopWidget::screenCountChanged, clearScreenGeometryCache);
+		connected = true;
+	}
+
+	const int screen = desktop->screenNumber(widget);
+	QHash<int, QRect> &cache = screenGeometryCache();
+	QHash<int, QRect>::const_iterator it = cache.constFind(screen);
+	if (it == cache.constEnd())
+		it = cache.insert(screen, desktop->availableGeometry(screen));
+	return it.value();
+}
+
+/*! \internal
+
 Pops up the color grid, and makes sure the status of
 QtColorPicker's button is right.
 */
@@ -189,22 +260,24 @@ void QtColorPicker::buttonPressed(bool toggled)
 	if (!toggled)
 		return;
 
-	const QRect desktop = QApplication::desktop()->geometry();
-	// Make sure the popup is inside the desktop.
+	popup->prepare();
+	const QSize size = popup->sizeHint();
+	const QRect desktop = availableScreenGeometry(this);
+
+	// Make sure the popup is inside the screen.
 	QPoint pos = mapToGlobal(rect().bottomLeft());
+	if (pos.x() + size.width() > desktop.right() + 1)
+		pos.setX(desktop.right() + 1 - size.width());
+	if (pos.y() + size.height() > desktop.bottom() + 1)
+		pos.setY(desktop.bottom() + 1 - size.height());
 	if (pos.x() < desktop.left())
 		pos.setX(desktop.left());
 	if (pos.y() < desktop.top())
 		pos.setY(desktop.top());
-
-	if ((pos.x() + popup->sizeHint().width()) > desktop.width())
-		pos.setX(desktop.width() - popup->sizeHint().width());
-	if ((pos.y() + popup->sizeHint().height()) > desktop.bottom())
-		pos.setY(desktop.bottom() - popup->sizeHint().height());
 	popup->move(pos);
 
 	if (ColorPickerItem *item = popup->find(col))
-		item->setSelected(true);
+		popup->select(item);
 
 	// Remove focus from this widget, preventing the focus rect
 	// from showing when the popup is shown. Order an update to
@@ -219,6 +292,26 @@ void QtColorPicker::buttonPressed(bool toggled)
 	popup->show();
 }
 
+/*! \internal
+
+Hovering or focusing the button is a good hint that the popup is
+about to be shown: get it ready while the user is still aiming.
+*/
+void QtColorPicker::enterEvent(QEvent *e)
+{
+	QPushButton::enterEvent(e);
+	popup->prepare();
+}
+
+/*! \internal
+
+*/
+void QtColorPicker::focusInEvent(QFocusEvent *e)
+{
+	QPushButton::focusInEvent(e);
+	popup->prepare();
+}
+
 /*!
 \internal
 */
@@ -270,6 +363,12 @@ void QtColorPicker::paintEvent(QPaintEvent *e)
 
 	QPushButton::paintEvent(e);
 
+	// The stylesheet gradient cannot show transparency: draw the
+	// color itself over a checkerboard inside the frame.
+	if (col.alpha() < 255) {
+		QPainter p(this);
+		QtSwatchCache::paint(&p, rect().adjusted(3, 3, -3, -3), col);
+	}
 }
 
 /*! \internal
@@ -282,6 +381,16 @@ void QtColorPicker::popupClosed()
 	setFocus();
 }
 
+/*! \internal
+
+Reverts consumers of colorPreviewed() to the current color once the
+popup is closed.
+*/
+void QtColorPicker::previewEnded()
+{
+	emit colorPreviewed(col);
+}
+
 /*!
 Returns the currently selected color.
 
@@ -300,6 +409,90 @@ QColor QtColorPicker::color(int index) const
 	return popup->color(index);
 }
 
+/*!
+Returns a remapper that maps any color, image or pixel buffer to the
+nearest color of the grid. Its lookup table is built the first time
+it is requested after the grid changes, and shared afterwards; the
+returned object can be used from worker threads.
+
+\sa QtPaletteRemapper
+*/
+QtPaletteRemapper QtColorPicker::paletteRemapper() const
+{
+	return popup->remapper();
+}
+
+/*!
+Returns a snapshot of the palette behind the grid: its entries, names
+and custom flags, with the same lookups, nearest match and tolerance
+as the picker. The palette only depends on QtCore and QtGui, so it
+can be handed to worker threads and headless renderers.
+
+\sa QtColorPalette
+*/
+QtColorPalette QtColorPicker::colorPalette() const
+{
+	return popup->colorPalette();
+}
+
+/*!
+Sorts the grid by \a key. Custom colors are sorted along with the
+palette colors.
+*/
+void QtColorPicker::sortColors(QtColorPalette::SortKey key)
+{
+	popup->sortColors(key);
+}
+
+/*!
+Replaces the palette colors of the grid with \a steps colors sampled
+evenly from \a map, named after the map and their position. Custom
+colors are kept. colorMap() then returns \a map, to color data the
+same way as the grid shows it, until the grid changes. An empty map
+is ignored.
+
+\sa QtColorMap::preset()
+*/
+void QtColorPicker::setColorMap(const QtColorMap &map, int steps)
+{
+	if (map.isEmpty())
+		return;
+
+	const QList<QColor> colors = map.colors(qMax(steps, 2));
+	QStringList names;
+	for (int i = 0; i < colors.size() && !map.name().isEmpty(); ++i)
+		names.append(QString("%1 %2%").arg(map.name()).arg(i * 100 / (colors.size() - 1)));
+
+	popup->applyPalette(colors, names);
+	mapSource = map;
+	mapRevision = popup->paletteRevision();
+	if (!firstInserted && popup->color(0).isValid())
+	{
+		col = popup->color(0);
+		firstInserted = true;
+	}
+}
+
+/*!
+Returns the map set with setColorMap(), as long as the grid has not
+changed since. Otherwise returns a map through the colors of the
+grid, in order, so that data is colored with whatever palette the
+picker shows.
+
+The map is a value: sample it from any thread with QtColorMap::map().
+*/
+QtColorMap QtColorPicker::colorMap() const
+{
+	if (!mapSource.isEmpty() && mapRevision == popup->paletteRevision())
+		return mapSource;
+
+	QList<QColor> stops;
+	const QVector<QRgb> colors = popup->colorPalette().colors();
+	for (int i = 0; i < colors.size(); ++i)
+		stops.append(QColor::fromRgba(colors.at(i)));
+	return QtColorMap(stops);
+}
+
 /*!
 Adds the 17 predefined colors from the Qt namespace.
 
@@ -310,39 +503,19 @@ all translatable.)
 */
 void QtColorPicker::setStandardColors()
 {
-	insertColor(Qt::black, tr("Black"));
-	insertColor(Qt::white, tr("White"));
-	insertColor(Qt::red, tr("Red"));
-	insertColor(Qt::darkRed, tr("Dark red"));
-	insertColor(Qt::green, tr("Green"));
-	insertColor(Qt::darkGreen, tr("Dark green"));
-	insertColor(Qt::blue, tr("Blue"));
-	insertColor(Qt::darkBlue, tr("Dark blue"));
-	insertColor(Qt::cyan, tr("Cyan"));
-	insertColor(Qt::darkCyan, tr("Dark cyan"));
-	insertColor(Qt::magenta, tr("Magenta"));
-	insertColor(Qt::darkMagenta, tr("Dark magenta"));
-	insertColor(Qt::yellow, tr("Yellow"));
-	insertColor(Qt::darkYellow, tr("Dark yellow"));
-	insertColor(Qt::gray, tr("Gray"));
-	insertColor(Qt::darkGray, tr("Dark gray"));
-	insertColor(Qt::lightGray, tr("Light gray"));
+	insertPalette(QtPaletteTable::standard());
 }
 void QtColorPicker::setColorsWithoutText()
 {
-	insertColor(Qt::black, tr(""));
-	insertColor(Qt::gray, tr(""));
-	insertColor(Qt::white, tr(""));
-	insertColor(Qt::red, tr(""));
-	insertColor(Qt::green, tr(""));
-	insertColor(Qt::blue, tr(""));
-	insertColor(Qt::magenta, tr(""));
+	insertPalette(QtPaletteTable::basic());
 }
 
 
 /*!
 Makes \a color current. If \a color is not already in the color grid, it
-is inserted with the text "Custom".
+is inserted with the text "Custom", or published to the shared recent
+colors if sharedRecentColors() is enabled. Colors just picked on one of
+the added pages or in the derived rows are not inserted.
 
 This function emits the colorChanged() signal if the new color is
 valid, and different from the old one.
@@ -352,14 +525,24 @@ void QtColorPicker::setCurrentColor(const QColor &color,  bool isText)
 	if (col == color || !color.isValid())
 		return;
 
-	ColorPickerItem *item = popup->find(color);
-	if (!item) 
+	ColorPickerItem *item = popup->findSimilar(color);
+	if (!item)
+		item = popup->findPicked(color);
+	if (!item && popup->recentColors())
+	{
+		// Shared custom colors are shown by every subscribed popup
+		// once the store notifies them, not inserted one by one.
+		popup->recentColors()->publish(color);
+	}
+	else if (!item) 
 	{
 		//if(isText)
 		//	insertColor(color, tr("Custom"));
 		//else
 		insertColor(color, tr(""));
-		item = popup->find(color);
+		item = popup->findSimilar(color);
+		if (item)
+			popup->setCustom(item, true);
 	}
 
 	col = color;
@@ -371,7 +554,7 @@ void QtColorPicker::setCurrentColor(const QColor &color,  bool isText)
 	repaint();
 
 	if(item)
-		item->setSelected(true);
+		popup->select(item);
 
 	emit colorChanged(color);
 }
@@ -393,6 +576,365 @@ void QtColorPicker::insertColor(const QColor &color, const QString &text, int in
 	}
 }
 
+/*! \property QtColorPicker::sharedRecentColors
+\brief Whether custom colors are shared with the other pickers.
+
+If this property is set to TRUE, colors picked from the dialog or set
+with setCurrentColor() that are not in the grid are published to
+QtRecentColors::instance() instead of being added to this picker's
+grid. Every picker with the property set shows those colors in a row
+below its grid. Pickers are notified once per event loop turn and
+only rebuild that row the next time their popup is shown.
+
+To share the colors with other processes as well, give the store a
+key with QtRecentColors::instance()->setSharedKey(); each popup then
+checks for colors picked elsewhere when it is shown.
+*/
+void QtColorPicker::setSharedRecentColors(bool enabled)
+{
+	popup->setRecentColors(enabled ? QtRecentColors::instance() : 0);
+}
+bool QtColorPicker::sharedRecentColors() const
+{
+	return popup->recentColors() != 0;
+}
+
+/*!
+Shows or hides an inline color field below the color grid. Dragging
+in the field previews colors through colorPreviewed(); releasing the
+mouse button picks the color, as if it had been chosen in the
+QColorDialog opened by the "..." button.
+
+\sa QtColorField
+*/
+void QtColorPicker::setColorFieldEnabled(bool enabled)
+{
+	popup->setColorFieldEnabled(enabled);
+}
+bool QtColorPicker::colorFieldEnabled() const
+{
+	return popup->colorField() != 0;
+}
+
+/*!
+Shows or hides a line edit below the color grid, where colors can be
+typed in any of the forms understood by QtColorParser. Entering a
+single color picks it, entering a list appends it to the grid.
+
+\sa insertColorText()
+*/
+void QtColorPicker::setColorEntryEnabled(bool enabled)
+{
+	popup->setColorEntryEnabled(enabled);
+}
+bool QtColorPicker::colorEntryEnabled() const
+{
+	return popup->colorEntry() != 0;
+}
+
+/*!
+Shows or hides a button next to the "..." one that turns the cursor
+into an eyedropper: a magnifier follows it and clicking anywhere on
+the screen picks the color under it, as a custom color.
+
+\sa setPixelSource()
+*/
+void QtColorPicker::setEyedropperEnabled(bool enabled)
+{
+	popup->setEyedropperEnabled(enabled);
+}
+bool QtColorPicker::eyedropperEnabled() const
+{
+	return popup->eyedropperEnabled();
+}
+
+/*!
+Makes the eyedropper read its pixels from \a source instead of the
+screens, e.g. a QtImagePixelSource on the offscreen platform. The
+source is not owned; 0 goes back to the screens.
+*/
+void QtColorPicker::setPixelSource(QtPixelSource *source)
+{
+	popup->setPixelSource(source);
+}
+
+/*!
+Returns a compact binary snapshot of the picker: the grid entries
+with their names and custom flags, the current color, the number of
+columns and the options. Restore it with restoreState().
+
+The format is versioned; names are stored as UTF-8 and colors as
+8 bit ARGB.
+*/
+QByteArray QtColorPicker::saveState() const
+{
+	QByteArray state;
+	QDataStream stream(&state, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint8 options = 0;
+	if (withColorDialog)
+		options |= DialogOption;
+	if (sharedRecentColors())
+		options |= SharedRecentOption;
+	if (firstInserted)
+		options |= FirstInsertedOption;
+
+	stream << quint32(StateMagic) << quint8(StateVersion) << options << quint32(col.rgba());
+	popup->saveState(stream);
+	return state;
+}
+
+/*!
+Restores the picker from \a state, as returned by saveState(). The
+grid is replaced in one pass: its items are created directly and laid
+out once, without going through insertColor().
+
+Returns false, leaving the picker untouched, if \a state is not a
+valid snapshot. colorChanged() is emitted if the current color
+changes.
+*/
+bool QtColorPicker::restoreState(const QByteArray &state)
+{
+	QDataStream stream(state);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic = 0;
+	quint8 version = 0;
+	quint8 options = 0;
+	quint32 current = 0;
+	stream >> magic >> version >> options >> current;
+	if (stream.status() != QDataStream::Ok || magic != StateMagic || version != StateVersion)
+		return false;
+	if (!popup->restoreState(stream))
+		return false;
+
+	withColorDialog = (options & DialogOption) != 0;
+	firstInserted = (options & FirstInsertedOption) != 0;
+	setSharedRecentColors((options & SharedRecentOption) != 0);
+
+	const QColor previous = col;
+	col = QColor::fromRgba(current);
+	if (ColorPickerItem *item = popup->find(col))
+		popup->select(item);
+	dirty = true;
+	update();
+
+	if (col != previous)
+		emit colorChanged(col);
+	return true;
+}
+
+/*!
+Appends \a colors to the color grid, named after the matching entries
+of \a texts, and lays the grid out once for the whole batch. Colors
+that are already present, or within colorTolerance() of an entry,
+are skipped.
+
+This is the fast path for large palettes, such as the ones returned
+by QtPaletteQuantizer::quantize().
+
+\sa insertColor()
+*/
+void QtColorPicker::insertColors(const QList<QColor> &colors, const QStringList &texts)
+{
+	popup->insertColors(colors, texts);
+	if (!firstInserted && popup->color(0).isValid())
+	{
+		col = popup->color(0);
+		firstInserted = true;
+	}
+}
+
+/*!
+Appends the colors of \a table to the color grid in one batch, as
+insertColors() does. The names are translated in the table's context
+the first time they are displayed.
+
+\sa QtPaletteTable
+*/
+void QtColorPicker::insertPalette(const QtPaletteTable &table)
+{
+	popup->insertPalette(table);
+	if (!firstInserted && popup->color(0).isValid())
+	{
+		col = popup->color(0);
+		firstInserted = true;
+	}
+}
+
+/*!
+Parses \a text with QtColorParser and returns the number of colors
+found. A single color is picked as if it had been chosen in the
+dialog; a list, such as a whole palette pasted from the clipboard,
+is appended to the grid through one insertColors() call.
+
+The same happens when the user presses the paste shortcut while the
+picker or its popup has the focus.
+*/
+int QtColorPicker::insertColorText(const QString &text)
+{
+	const int count = popup->insertColorText(text);
+	if (!firstInserted && popup->color(0).isValid())
+	{
+		col = popup->color(0);
+		firstInserted = true;
+	}
+	return count;
+}
+
+/*!
+Removes the entry at \a index from the color grid. The current
+color is left as is, even if it was that entry.
+*/
+void QtColorPicker::removeColor(int index)
+{
+	popup->removeColor(index);
+}
+
+/*!
+Fills the color grid from the palette file \a fileName, in any of
+the formats read by QtPaletteFile, and keeps it in sync with the
+file: each time the file is saved, it is read again off the GUI
+thread and only the entries that differ are updated in the grid.
+Custom colors picked by the user are kept after the file entries.
+
+An empty \a fileName stops watching; the grid is left as is.
+*/
+void QtColorPicker::setPaletteFile(const QString &fileName)
+{
+	if (!paletteSource) {
+		if (fileName.isEmpty())
+			return;
+		paletteSource = new QtPaletteFile(this);
+		connect(paletteSource, SIGNAL(loaded()), SLOT(paletteFileLoaded()));
+	}
+	paletteSource->setFileName(fileName);
+}
+QString QtColorPicker::paletteFile() const
+{
+	return paletteSource ? paletteSource->fileName() : QString();
+}
+
+/*! \internal
+
+*/
+void QtColorPicker::paletteFileLoaded()
+{
+	mapSource = QtColorMap();
+	popup->applyPalette(paletteSource->colors(), paletteSource->names());
+	if (!firstInserted && popup->color(0).isValid())
+	{
+		col = popup->color(0);
+		firstInserted = true;
+	}
+}
+
+/*!
+Adds a page of \a colors, named after the matching entries of
+\a texts, and returns its index. As soon as there is a second page,
+a tab bar titled \a title for this page switches between the color
+grid, page 0, and the added pages.
+
+Pages are cheap until they are shown: their items are created the
+first time the page is viewed, and kept while other pages are.
+*/
+int QtColorPicker::addPalettePage(const QString &title, const QList<QColor> &colors, const QStringList &texts)
+{
+	return popup->addPage(title, colors, texts);
+}
+int QtColorPicker::palettePageCount() const
+{
+	return popup->pageCount();
+}
+
+/*!
+Shows the page at index \a page in the popup.
+*/
+void QtColorPicker::setCurrentPalettePage(int page)
+{
+	popup->setCurrentPage(page);
+}
+int QtColorPicker::currentPalettePage() const
+{
+	return popup->currentPage();
+}
+
+/*!
+Shows derived rows below the color grid: \a rows is a combination of
+DerivedRow values. The rows follow the grid color under the mouse or
+the keyboard focus, with tints and shades mixed in OKLab and
+complementary, triadic and analogous harmonies turned in OKLCH.
+
+A row is only computed when its base color is browsed, and kept per
+base color, so a small palette gets all its variations without
+inserting them.
+*/
+void QtColorPicker::setDerivedRows(int rows)
+{
+	popup->setDerivedRows(rows);
+}
+int QtColorPicker::derivedRows() const
+{
+	return popup->derivedRows();
+}
+
+/*!
+Sets the colors, typically backgrounds, that the grid colors are
+checked against with setMinimumContrast().
+*/
+void QtColorPicker::setContrastReferences(const QList<QColor> &references)
+{
+	popup->setContrastReferences(references);
+}
+QList<QColor> QtColorPicker::contrastReferences() const
+{
+	return popup->contrastReferences();
+}
+
+/*!
+Marks the grid colors whose WCAG 2 contrast ratio against one of the
+contrastReferences() is below \a ratio, with a diagonal stroke, or
+leaves them out of the grid if \a hideFailing is true. A \a ratio of
+0 turns the check off.
+
+The ratios are computed for the whole grid in one batch, and only
+again once the grid has changed.
+*/
+void QtColorPicker::setMinimumContrast(qreal ratio, bool hideFailing)
+{
+	popup->setMinimumContrast(ratio, hideFailing);
+}
+qreal QtColorPicker::minimumContrast() const
+{
+	return popup->minimumContrast();
+}
+
+/*!
+Returns the contrast ratio of each grid color against each of the
+contrastReferences(): the ratio of color(i) against reference r is
+at index r * n + i, n being the number of grid colors.
+
+\sa QtColorSpace::contrastRatios()
+*/
+QVector<float> QtColorPicker::contrastRatios() const
+{
+	return popup->contrastRatios();
+}
+
+/*! \internal
+
+Pastes the colors on the clipboard; see insertColorText().
+*/
+void QtColorPicker::keyPressEvent(QKeyEvent *e)
+{
+	if (e->matches(QKeySequence::Paste)) {
+		insertColorText(QApplication::clipboard()->text());
+		return;
+	}
+	QPushButton::keyPressEvent(e);
+}
+
 /*! \property QtColorPicker::colorDialog
 \brief Whether the ellipsis "..." (more) button is available.
 
@@ -410,6 +952,23 @@ bool QtColorPicker::colorDialogEnabled() const
 	return withColorDialog;
 }
 
+/*!
+Sets the perceptual tolerance used when colors are inserted. A color
+whose CIE76 Delta E to an existing entry is below \a deltaE is folded
+into that entry instead of getting a swatch of its own. The default,
+0, only folds exact duplicates.
+
+\sa ColorPickerPopup::setColorTolerance()
+*/
+void QtColorPicker::setColorTolerance(qreal deltaE)
+{
+	popup->setColorTolerance(deltaE);
+}
+qreal QtColorPicker::colorTolerance() const
+{
+	return popup->colorTolerance();
+}
+
 /*!
 Pops up a color grid with Qt default colors at \a point, using
 global coordinates. If \a allowCustomColors is true, there will
@@ -429,24 +988,7 @@ QColor color = QtColorPicker::getColor(mapToGlobal(e->pos()));
 QColor QtColorPicker::getColor(const QPoint &point, bool allowCustomColors)
 {
 	ColorPickerPopup popup(-1, allowCustomColors);
-
-	popup.insertColor(Qt::black, tr("Black"), 0);
-	popup.insertColor(Qt::white, tr("White"), 1);
-	popup.insertColor(Qt::red, tr("Red"), 2);
-	popup.insertColor(Qt::darkRed, tr("Dark red"), 3);
-	popup.insertColor(Qt::green, tr("Green"), 4);
-	popup.insertColor(Qt::darkGreen, tr("Dark green"), 5);
-	popup.insertColor(Qt::blue, tr("Blue"), 6);
-	popup.insertColor(Qt::darkBlue, tr("Dark blue"), 7);
-	popup.insertColor(Qt::cyan, tr("Cyan"), 8);
-	popup.insertColor(Qt::darkCyan, tr("Dark cyan"), 9);
-	popup.insertColor(Qt::magenta, tr("Magenta"), 10);
-	popup.insertColor(Qt::darkMagenta, tr("Dark magenta"), 11);
-	popup.insertColor(Qt::yellow, tr("Yellow"), 12);
-	popup.insertColor(Qt::darkYellow, tr("Dark yellow"), 13);
-	popup.insertColor(Qt::gray, tr("Gray"), 14);
-	popup.insertColor(Qt::darkGray, tr("Dark gray"), 15);
-	popup.insertColor(Qt::lightGray, tr("Light gray"), 16);
+	popup.insertPalette(QtPaletteTable::standard());
 
 	popup.move(point);
 	popup.exec();
@@ -463,7 +1005,18 @@ ColorPickerPopup::ColorPickerPopup(int width, bool withColorDialog,
 								   bool iWithAlphaChannel)
 								   : QFrame(parent, f),
 								   isPopup(true),
-								   withAlpha(iWithAlphaChannel)
+								   withAlpha(iWithAlphaChannel),
+								   paletteVersion(0),
+								   recentStore(0),
+								   recentDirty(false),
+								   selectedItem(0),
+								   prepared(false),
+								   derivedKinds(0),
+								   minContrast(0),
+								   hideLowContrast(false),
+								   contrastVersion(-1),
+								   markedVersion(-1),
+								   previewActive(false)
 {
 	if( f == Qt::Widget)
 	{
@@ -498,7 +1051,18 @@ ColorPickerPopup::ColorPickerPopup(int width, bool withColorDialog,
 	{
 		moreButton = 0;
 	}
-
+	dropperButton = 0;
+	dropper = 0;
+	pixelSource = 0;
+
+	previewTimer = new QTimer(this);
+	previewTimer->setSingleShot(true);
+	previewTimer->setInterval(16);
+	connect(previewTimer, SIGNAL(timeout()), SLOT(emitPreview()));
+
+	field = 0;
+	entry = 0;
+	pageBar = 0;
 	eventLoop = 0;
 	grid = 0;
 	regenerateGrid();
@@ -514,74 +1078,1152 @@ ColorPickerPopup::~ColorPickerPopup()
 {
 	if (eventLoop)
 		eventLoop->exit();
+	delete dropper;
 }
 
 /*! \internal
 
 If there is an item whole color is equal to \a col, returns a
-pointer to this item; otherwise returns 0.
+pointer to this item; otherwise returns 0. The palette indexes its
+entries by ARGB value, so the lookup does not depend on the grid size.
 */
 ColorPickerItem *ColorPickerPopup::find(const QColor &col) const
 {
-	for (int i = 0; i < items.size(); ++i) {
-		if (items.at(i) && items.at(i)->color() == col)
-			return items.at(i);
-	}
-
-	return 0;
+	return items.value(paletteModel.indexOf(col), 0);
 }
 
 /*! \internal
 
-Adds \a item to the grid. The items are added from top-left to
-bottom-right.
+Marks \a item as the selected item, and unmarks the previous one.
+The selected item is remembered, so neither this nor showing the
+popup has to scan the grid.
 */
-void ColorPickerPopup::insertColor(const QColor &col, const QString &text, int index)
+void ColorPickerPopup::select(ColorPickerItem *item)
 {
-	// Don't add colors that we have already.
-	ColorPickerItem *existingItem = find(col);
+	if (selectedItem && selectedItem != item)
+		selectedItem->setSelected(false);
+
+	selectedItem = item;
+	if (item)
+		item->setSelected(true);
+}
+
+/*! \internal
+
+Writes the grid entries and the popup settings to \a stream, in the
+format read by restoreState().
+*/
+void ColorPickerPopup::saveState(QDataStream &stream) const
+{
+	quint8 options = 0;
+	if (withAlpha)
+		options |= AlphaOption;
+	if (lastSel.isValid())
+		options |= SelectionOption;
+
+	stream << options << qint32(cols) << double(paletteModel.tolerance()) << quint32(lastSel.rgba());
+	paletteModel.save(stream);
+}
+
+/*! \internal
+
+Replaces the grid with the entries read from \a stream. The whole
+stream is read and checked by QtColorPalette::load() before anything
+changes; the items are then created directly, and the grid is laid
+out once. Returns false if the stream is truncated or corrupt.
+*/
+bool ColorPickerPopup::restoreState(QDataStream &stream)
+{
+	quint8 options = 0;
+	qint32 columns = -1;
+	double deltaE = 0;
+	quint32 selection = 0;
+	stream >> options >> columns >> deltaE >> selection;
+	if (stream.status() != QDataStream::Ok)
+		return false;
+
+	// Each entry takes at least MinEntrySize bytes, so a count the
+	// remaining data cannot hold comes from a corrupt header, and is
+	// rejected before anything is allocated for it.
+	if (QIODevice *device = stream.device()) {
+		QDataStream peek(device->peek(sizeof(quint32)));
+		peek.setByteOrder(stream.byteOrder());
+		quint32 count = 0;
+		peek >> count;
+		if (peek.status() != QDataStream::Ok
+			|| quint64(count) * MinEntrySize > quint64(device->bytesAvailable() - sizeof(quint32)))
+			return false;
+	}
+
+	QtColorPalette loaded;
+	loaded.setTolerance(deltaE);
+	if (!loaded.load(stream))
+		return false;
+
+	if (selectedItem && !recentItems.contains(selectedItem))
+		selectedItem = 0;
+	qDeleteAll(items);
+	items.clear();
+
+	paletteModel = loaded;
+	cols = columns;
+	withAlpha = (options & AlphaOption) != 0;
+	lastSel = (options & SelectionOption) ? QColor::fromRgba(selection) : QColor();
+
+	const int count = paletteModel.count();
+	items.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		ColorPickerItem *item = new ColorPickerItem(paletteModel.color(i), paletteModel.name(i), this);
+		item->setCustom(paletteModel.isCustom(i));
+		connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+		connect(item, SIGNAL(hovered()), SLOT(itemHovered()));
+		items.append(item);
+	}
+
+	if (ColorPickerItem *item = find(lastSel))
+		select(item);
+
+	++paletteVersion;
+	regenerateGrid();
+	update();
+	return true;
+}
+
+/*! \internal
+
+Polishes the popup and lays it out ahead of showing it, and caches
+its size hint. Does nothing if the popup is already prepared.
+*/
+void ColorPickerPopup::prepare()
+{
+	if (prepared)
+		return;
+
+	ensurePolished();
+	if (grid)
+		grid->activate();
+	sizeHint();
+	prepared = true;
+}
+
+/*! \internal
+
+Returns the size hint of the grid. It is computed once per layout
+and cached until the grid, the font or the style change.
+*/
+QSize ColorPickerPopup::sizeHint() const
+{
+	if (!cachedSizeHint.isValid())
+		cachedSizeHint = QFrame::sizeHint();
+	return cachedSizeHint;
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::changeEvent(QEvent *e)
+{
+	if (e->type() == QEvent::StyleChange || e->type() == QEvent::FontChange) {
+		cachedSizeHint = QSize();
+		prepared = false;
+	}
+	QFrame::changeEvent(e);
+}
+
+/*! \internal
+
+Returns the item whose color is closest to \a col, provided it lies
+within colorTolerance(); otherwise returns 0.
+
+\sa QtColorPalette::indexOfSimilar()
+*/
+ColorPickerItem *ColorPickerPopup::findSimilar(const QColor &col) const
+{
+	return items.value(paletteModel.indexOfSimilar(col), 0);
+}
+
+/*! \internal
+
+Returns the selected item if it holds \a col and lies outside the
+grid, on one of the added pages or in a derived row; otherwise
+returns 0. Colors picked there are already shown, so they are not
+inserted into the grid.
+*/
+ColorPickerItem *ColorPickerPopup::findPicked(const QColor &col) const
+{
+	if (!selectedItem || selectedItem->color() != col)
+		return 0;
+	if (selectedItem->parentWidget() == this && !isDerived(selectedItem))
+		return 0;
+	return selectedItem;
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::setColorTolerance(qreal deltaE)
+{
+	paletteModel.setTolerance(deltaE);
+}
+
+/*! \internal
+
+*/
+qreal ColorPickerPopup::colorTolerance() const
+{
+	return paletteModel.tolerance();
+}
+
+/*! \internal
+
+Adds \a item to the grid. The items are added from top-left to
+bottom-right.
+*/
+void ColorPickerPopup::insertColor(const QColor &col, const QString &text, int index)
+{
+	// Don't add colors that we have already, or that are too close
+	// to one we have to be told apart.
+	ColorPickerItem *existingItem = findSimilar(col);
 	ColorPickerItem *lastSelectedItem = find(lastSelected());
 
-	if (existingItem) {
-		if (lastSelectedItem && existingItem != lastSelectedItem)
-			lastSelectedItem->setSelected(false);
-		existingItem->setFocus();
-		existingItem->setSelected(true);
+	if (existingItem) {
+		if (lastSelectedItem && existingItem != lastSelectedItem)
+			lastSelectedItem->setSelected(false);
+		existingItem->setFocus();
+		select(existingItem);
+		return;
+	}
+
+	index = paletteModel.insert(col, text, index);
+	if (index == -1)
+		return;
+
+	ColorPickerItem *item = new ColorPickerItem(col, text, this);
+
+	if (lastSelectedItem) {
+		lastSelectedItem->setSelected(false);
+		if (selectedItem == lastSelectedItem)
+			selectedItem = 0;
+	}
+	else {
+		select(item);
+		lastSel = col;
+	}
+	item->setFocus();
+
+	connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+	connect(item, SIGNAL(hovered()), SLOT(itemHovered()));
+	items.insert(index, item);
+	++paletteVersion;
+	regenerateGrid();
+
+	update();
+}
+
+/*! \internal
+
+Appends \a colors to the grid with a single call to regenerateGrid().
+*/
+void ColorPickerPopup::insertColors(const QList<QColor> &colors, const QStringList &texts)
+{
+	bool hasSelection = find(lastSelected()) != 0;
+	int inserted = 0;
+	for (int i = 0; i < colors.size(); ++i) {
+		const QColor &col = colors.at(i);
+		const QString text = i < texts.size() ? texts.at(i) : QString();
+		if (paletteModel.insert(col, text) == -1)
+			continue;
+
+		appendItem(new ColorPickerItem(col, text, this), hasSelection);
+		++inserted;
+	}
+
+	if (inserted) {
+		++paletteVersion;
+		regenerateGrid();
+		update();
+	}
+}
+
+/*! \internal
+
+Appends the colors of \a table with a single call to regenerateGrid().
+The palette keeps the entries it did not already have, in table
+order, so the items are created by walking the table along the new
+entries. They keep the untranslated names and translate them when
+they are first displayed.
+*/
+void ColorPickerPopup::insertPalette(const QtPaletteTable &table)
+{
+	bool hasSelection = find(lastSelected()) != 0;
+	int next = paletteModel.count();
+	if (!paletteModel.insert(table))
+		return;
+
+	const int count = paletteModel.count();
+	for (int i = 0; i < table.count && next < count; ++i) {
+		const QtPaletteEntry &entry = table.entries[i];
+		if (paletteModel.color(next).rgba() != entry.rgba)
+			continue;
+
+		appendItem(new ColorPickerItem(QColor::fromRgba(entry.rgba), table.context, entry.key, this), hasSelection);
+		++next;
+	}
+
+	++paletteVersion;
+	regenerateGrid();
+	update();
+}
+
+/*! \internal
+
+Connects a new \a item, already in the palette, at the end of the
+grid, and selects it if nothing is selected yet.
+*/
+void ColorPickerPopup::appendItem(ColorPickerItem *item, bool &hasSelection)
+{
+	if (!hasSelection) {
+		select(item);
+		lastSel = item->color();
+		hasSelection = true;
+	}
+
+	connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+	connect(item, SIGNAL(hovered()), SLOT(itemHovered()));
+	items.append(item);
+}
+
+/*! \internal
+
+Removes the item at \a index and lays the grid out again.
+*/
+void ColorPickerPopup::removeColor(int index)
+{
+	if (index < 0 || index >= items.size())
+		return;
+
+	ColorPickerItem *item = items.takeAt(index);
+	paletteModel.remove(index);
+	if (!item)
+		return;
+
+	if (selectedItem == item)
+		selectedItem = 0;
+	delete item;
+
+	++paletteVersion;
+	regenerateGrid();
+	update();
+}
+
+/*! \internal
+
+Makes the palette entries of the grid match \a colors and \a texts,
+touching as few items as possible. Entries are matched by color
+first, which keeps renamed and moved entries, then in order, which
+turns the remaining differences into recolors. Only what is left is
+created or deleted, and the grid is laid out again only if the
+order or the number of items changed. Custom items are kept, after
+the palette entries.
+*/
+void ColorPickerPopup::applyPalette(const QList<QColor> &colors, const QStringList &texts)
+{
+	QList<ColorPickerItem *> entries;
+	QList<ColorPickerItem *> custom;
+	for (int i = 0; i < items.size(); ++i) {
+		if (items.at(i))
+			(items.at(i)->isCustom() ? custom : entries).append(items.at(i));
+	}
+
+	// Inserted backwards so that find() returns the first entry of
+	// each color.
+	QMultiHash<QRgb, int> unmatched;
+	for (int i = entries.size() - 1; i >= 0; --i)
+		unmatched.insert(entries.at(i)->color().rgba(), i);
+
+	QVector<ColorPickerItem *> matched(colors.size(), 0);
+	QVector<bool> used(entries.size(), false);
+	for (int i = 0; i < colors.size(); ++i) {
+		QMultiHash<QRgb, int>::iterator it = unmatched.find(colors.at(i).rgba());
+		if (it != unmatched.end()) {
+			matched[i] = entries.at(it.value());
+			used[it.value()] = true;
+			unmatched.erase(it);
+		}
+	}
+
+	QList<ColorPickerItem *> spare;
+	for (int i = 0; i < entries.size(); ++i) {
+		if (!used.at(i))
+			spare.append(entries.at(i));
+	}
+
+	bool recolored = false;
+	bool renamed = false;
+	bool relayout = false;
+	QList<ColorPickerItem *> updated;
+	updated.reserve(colors.size() + custom.size());
+	for (int i = 0; i < colors.size(); ++i) {
+		const QString text = i < texts.size() ? texts.at(i) : QString();
+		ColorPickerItem *item = matched.at(i);
+		if (item) {
+			if (item->name() != text) {
+				item->setColor(item->color(), text);
+				renamed = true;
+			}
+		} else if (!spare.isEmpty()) {
+			item = spare.takeFirst();
+			item->setColor(colors.at(i), text);
+			recolored = true;
+		} else {
+			item = new ColorPickerItem(colors.at(i), text, this);
+			connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+			connect(item, SIGNAL(hovered()), SLOT(itemHovered()));
+			relayout = true;
+		}
+		updated.append(item);
+	}
+
+	for (int i = 0; i < spare.size(); ++i) {
+		if (selectedItem == spare.at(i))
+			selectedItem = 0;
+		delete spare.at(i);
+		relayout = true;
+	}
+
+	updated += custom;
+	relayout = relayout || updated != items;
+	if (!relayout && !recolored && !renamed)
+		return;
+
+	// The palette is rebuilt from the items, duplicates included, so
+	// that it stays aligned with the grid. Names still read from a
+	// QtPaletteTable stay untranslated.
+	items = updated;
+	QtColorPalette rebuilt;
+	rebuilt.setTolerance(paletteModel.tolerance());
+	for (int i = 0; i < items.size(); ++i) {
+		const ColorPickerItem *item = items.at(i);
+		if (item->nameKey())
+			rebuilt.appendTranslatable(item->color(), item->nameContext(), item->nameKey(), item->isCustom());
+		else
+			rebuilt.append(item->color(), item->name(), item->isCustom());
+	}
+	paletteModel = rebuilt;
+	if (!relayout && !recolored)
+		return;
+
+	if (!recentItems.contains(selectedItem))
+		select(find(lastSel));
+
+	++paletteVersion;
+	if (relayout)
+		regenerateGrid();
+	update();
+}
+
+/*! \internal
+
+The items of the rows are created here, once; browsing the grid only
+recolors them.
+*/
+void ColorPickerPopup::setDerivedRows(int rows)
+{
+	if (rows == derivedKinds)
+		return;
+
+	for (int i = 0; i < derived.size(); ++i) {
+		if (derived.at(i).items.contains(selectedItem))
+			selectedItem = 0;
+		qDeleteAll(derived.at(i).items);
+	}
+	derived.clear();
+	derivedKinds = rows;
+	derivedBase = QColor();
+
+	static const int kinds[] = { QtColorPicker::TintRow, QtColorPicker::ShadeRow, QtColorPicker::ComplementaryRow,
+		QtColorPicker::TriadicRow, QtColorPicker::AnalogousRow };
+	for (unsigned k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+		if (!(rows & kinds[k]))
+			continue;
+
+		DerivedItems row;
+		row.kind = kinds[k];
+		const int count = derivedRamp(row.kind, qRgb(128, 128, 128)).size();
+		for (int i = 0; i < count; ++i) {
+			ColorPickerItem *item = new ColorPickerItem(Qt::gray, QString(), this);
+			connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+			connect(item, SIGNAL(hovered()), SLOT(itemHovered()));
+			row.items.append(item);
+		}
+		derived.append(row);
+	}
+
+	regenerateGrid();
+	if (isVisible())
+		updateDerivedRows(lastSel.isValid() ? lastSel : color(0));
+}
+
+/*! \internal
+
+*/
+int ColorPickerPopup::derivedRows() const
+{
+	return derivedKinds;
+}
+
+/*! \internal
+
+Returns the colors of the derived row \a kind for \a base, computing
+them on first use.
+*/
+QVector<QRgb> ColorPickerPopup::derivedRamp(int kind, QRgb base)
+{
+	const quint64 key = (quint64(kind) << 32) | base;
+	QHash<quint64, QVector<QRgb> >::const_iterator it = rampCache.constFind(key);
+	if (it != rampCache.constEnd())
+		return it.value();
+
+	QVector<QRgb> ramp;
+	switch (kind) {
+	case QtColorPicker::TintRow:
+	case QtColorPicker::ShadeRow: {
+		const QRgb end = kind == QtColorPicker::TintRow ? qRgba(255, 255, 255, qAlpha(base)) : qRgba(0, 0, 0, qAlpha(base));
+		for (int i = 1; i <= DerivedSteps; ++i)
+			ramp.append(QtColorSpace::mixOklab(base, end, float(i) / (DerivedSteps + 1)));
+		break;
+	}
+	case QtColorPicker::ComplementaryRow:
+		ramp << base << QtColorSpace::rotateHue(base, 180);
+		break;
+	case QtColorPicker::TriadicRow:
+		ramp << base << QtColorSpace::rotateHue(base, 120) << QtColorSpace::rotateHue(base, 240);
+		break;
+	case QtColorPicker::AnalogousRow:
+		ramp << QtColorSpace::rotateHue(base, -60) << QtColorSpace::rotateHue(base, -30) << base
+			<< QtColorSpace::rotateHue(base, 30) << QtColorSpace::rotateHue(base, 60);
+		break;
+	}
+
+	if (rampCache.size() >= MaxCachedRamps)
+		rampCache.clear();
+	rampCache.insert(key, ramp);
+	return ramp;
+}
+
+/*! \internal
+
+Recolors the derived rows for \a base. A selected derived item no
+longer holds the picked color afterwards, so it is deselected.
+*/
+void ColorPickerPopup::updateDerivedRows(const QColor &base)
+{
+	if (derived.isEmpty() || !base.isValid() || base == derivedBase)
+		return;
+
+	derivedBase = base;
+	for (int i = 0; i < derived.size(); ++i) {
+		const DerivedItems &row = derived.at(i);
+		const QVector<QRgb> ramp = derivedRamp(row.kind, base.rgba());
+		const QString text = row.kind == QtColorPicker::TintRow ? tr("Tint")
+			: row.kind == QtColorPicker::ShadeRow ? tr("Shade") : tr("Harmony");
+		for (int j = 0; j < row.items.size() && j < ramp.size(); ++j) {
+			ColorPickerItem *item = row.items.at(j);
+			if (item == selectedItem && item->color().rgba() != ramp.at(j))
+				select(0);
+			item->setColor(QColor::fromRgba(ramp.at(j)), text);
+		}
+	}
+}
+
+/*! \internal
+
+Returns true if \a item belongs to a derived row.
+*/
+bool ColorPickerPopup::isDerived(const ColorPickerItem *item) const
+{
+	for (int i = 0; i < derived.size(); ++i) {
+		if (derived.at(i).items.contains(const_cast<ColorPickerItem *>(item)))
+			return true;
+	}
+	return false;
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::setContrastReferences(const QList<QColor> &references)
+{
+	contrastRefs = references;
+	contrastVersion = -1;
+	markedVersion = -1;
+	if (isVisible())
+		updateContrastMarks();
+}
+
+/*! \internal
+
+*/
+QList<QColor> ColorPickerPopup::contrastReferences() const
+{
+	return contrastRefs;
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::setMinimumContrast(qreal ratio, bool hideFailing)
+{
+	// Toggling hideFailing changes the layout even when no mark does.
+	const bool relayout = hideLowContrast != hideFailing;
+	minContrast = qMax(qreal(0), ratio);
+	hideLowContrast = hideFailing;
+	markedVersion = -1;
+	if (isVisible())
+		updateContrastMarks(relayout);
+	else if (relayout)
+		regenerateGrid();
+}
+
+/*! \internal
+
+*/
+qreal ColorPickerPopup::minimumContrast() const
+{
+	return minContrast;
+}
+
+/*! \internal
+
+Returns the ratios of the grid colors against the references, laid
+out reference by reference. They are computed in one batch and kept
+until the grid or the references change.
+*/
+QVector<float> ColorPickerPopup::contrastRatios() const
+{
+	if (contrastVersion != paletteVersion) {
+		QVector<QRgb> colors;
+		colors.reserve(items.size());
+		for (int i = 0; i < items.size(); ++i)
+			colors.append(items.at(i) ? items.at(i)->color().rgba() : 0);
+		QVector<QRgb> references;
+		references.reserve(contrastRefs.size());
+		for (int i = 0; i < contrastRefs.size(); ++i)
+			references.append(contrastRefs.at(i).rgba());
+
+		cachedContrast.resize(colors.size() * references.size());
+		QtColorSpace::contrastRatios(colors.constData(), colors.size(),
+			references.constData(), references.size(), cachedContrast.data());
+		contrastVersion = paletteVersion;
+	}
+	return cachedContrast;
+}
+
+/*! \internal
+
+Flags the items that fail the minimum contrast against any reference.
+The grid is laid out again if some hidden item changed state, or
+always when \a forceLayout is true.
+*/
+void ColorPickerPopup::updateContrastMarks(bool forceLayout)
+{
+	markedVersion = paletteVersion;
+
+	const int count = items.size();
+	const int references = contrastRefs.size();
+	const bool check = minContrast > 0 && references > 0;
+	const QVector<float> ratios = check ? contrastRatios() : QVector<float>();
+
+	bool relayout = forceLayout;
+	for (int i = 0; i < count; ++i) {
+		ColorPickerItem *item = items.at(i);
+		if (!item)
+			continue;
+
+		bool low = false;
+		for (int r = 0; check && r < references && !low; ++r)
+			low = ratios.at(r * count + i) < minContrast;
+		if (low != item->isLowContrast()) {
+			item->setLowContrast(low);
+			relayout = relayout || hideLowContrast;
+		}
+	}
+
+	if (relayout)
+		regenerateGrid();
+}
+
+/*! \internal
+
+Returns true if \a item is left out of the grid.
+*/
+bool ColorPickerPopup::isFiltered(const ColorPickerItem *item) const
+{
+	return hideLowContrast && item->isLowContrast();
+}
+
+/*! \internal
+
+Parses \a text and adds what it holds: a single color is picked like
+a custom color, a list is appended to the grid in one batch. Returns
+the number of colors found.
+*/
+int ColorPickerPopup::insertColorText(const QString &text)
+{
+	QVector<QRgb> parsed;
+	const int count = QtColorParser::parseList(text, &parsed);
+	if (count == 1) {
+		addCustomColor(QColor::fromRgba(parsed.at(0)));
+	} else if (count > 1) {
+		QList<QColor> colors;
+		colors.reserve(count);
+		for (int i = 0; i < count; ++i)
+			colors.append(QColor::fromRgba(parsed.at(i)));
+		insertColors(colors, QStringList());
+	}
+	return count;
+}
+
+/*! \internal
+
+The entry is created on first use and laid out across the whole
+width of the grid, below the color field if there is one.
+*/
+void ColorPickerPopup::setColorEntryEnabled(bool enabled)
+{
+	if (enabled == (entry != 0))
+		return;
+
+	if (enabled) {
+		entry = new QLineEdit(this);
+		entry->setPlaceholderText(tr("#rrggbb, rgb(), hsl() or name"));
+		entry->setClearButtonEnabled(true);
+		connect(entry, SIGNAL(returnPressed()), SLOT(entryReturnPressed()));
+	} else {
+		delete entry;
+		entry = 0;
+	}
+	regenerateGrid();
+}
+
+/*! \internal
+
+*/
+QLineEdit *ColorPickerPopup::colorEntry() const
+{
+	return entry;
+}
+
+/*! \internal
+
+The button goes next to the "..." one. The eyedropper itself is
+created on first use.
+*/
+void ColorPickerPopup::setEyedropperEnabled(bool enabled)
+{
+	if (enabled == (dropperButton != 0))
+		return;
+
+	if (enabled) {
+		dropperButton = new ColorPickerButton(this);
+		dropperButton->setText(QString(QChar(0x2316)));
+		dropperButton->setToolTip(tr("Pick a color from the screen"));
+		connect(dropperButton, SIGNAL(clicked()), SLOT(startEyedropper()));
+	} else {
+		delete dropperButton;
+		dropperButton = 0;
+	}
+	regenerateGrid();
+}
+
+/*! \internal
+
+*/
+bool ColorPickerPopup::eyedropperEnabled() const
+{
+	return dropperButton != 0;
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::setPixelSource(QtPixelSource *source)
+{
+	pixelSource = source;
+	if (dropper)
+		dropper->setPixelSource(source);
+}
+
+/*! \internal
+
+The eyedropper is a top level window of its own, so that it outlives
+the popup being hidden while the user points at the screen. What it
+hovers is previewed, even though the popup is hidden, and what it
+picks is added as a custom color.
+*/
+void ColorPickerPopup::startEyedropper()
+{
+	if (!dropper) {
+		dropper = new QtEyedropper;
+		connect(dropper, SIGNAL(hovered(const QColor &)), SLOT(fieldColorChanged(const QColor &)));
+		connect(dropper, SIGNAL(picked(const QColor &)), SLOT(addCustomColor(const QColor &)));
+		connect(dropper, SIGNAL(picked(const QColor &)), SLOT(eyedropperFinished()));
+		connect(dropper, SIGNAL(cancelled()), SLOT(eyedropperFinished()));
+		dropper->setPixelSource(pixelSource);
+	}
+
+	if (isPopup)
+		hide();
+	lastPreview = QColor();
+	dropper->start();
+}
+
+/*! \internal
+
+Ends the preview of the eyedropper, after its pick has been selected
+or when it was cancelled.
+*/
+void ColorPickerPopup::eyedropperFinished()
+{
+	previewTimer->stop();
+	if (previewActive) {
+		previewActive = false;
+		emit previewEnded();
+	}
+}
+
+/*! \internal
+
+Only the colors are stored here; the page is built by setCurrentPage()
+when it is first shown. The tab bar is created with the first added
+page.
+*/
+int ColorPickerPopup::addPage(const QString &title, const QList<QColor> &colors, const QStringList &texts)
+{
+	Page page;
+	page.title = title;
+	page.colors = colors;
+	page.texts = texts;
+	page.widget = 0;
+	pages.append(page);
+
+	if (!pageBar) {
+		pageBar = new QTabBar(this);
+		pageBar->setDrawBase(false);
+		pageBar->setExpanding(false);
+		pageBar->setFocusPolicy(Qt::NoFocus);
+		pageBar->addTab(tr("Palette"));
+		connect(pageBar, SIGNAL(currentChanged(int)), SLOT(pageChanged(int)));
+		grid->setMenuBar(pageBar);
+	}
+	pageBar->addTab(title);
+	cachedSizeHint = QSize();
+	prepared = false;
+	return pages.size();
+}
+
+/*! \internal
+
+*/
+int ColorPickerPopup::pageCount() const
+{
+	return pages.size() + 1;
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::setPageTitle(int page, const QString &title)
+{
+	if (page > 0 && page <= pages.size())
+		pages[page - 1].title = title;
+	if (pageBar)
+		pageBar->setTabText(page, title);
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::setCurrentPage(int page)
+{
+	if (pageBar)
+		pageBar->setCurrentIndex(page);
+}
+
+/*! \internal
+
+*/
+int ColorPickerPopup::currentPage() const
+{
+	return pageBar ? pageBar->currentIndex() : 0;
+}
+
+/*! \internal
+
+Creates the items of \a page, in a widget of its own laid over the
+first row of the grid.
+*/
+void ColorPickerPopup::buildPage(Page &page)
+{
+	int columns = cols;
+	if (columns == -1)
+		columns = (int) ceil(sqrt((float) page.colors.count()));
+	columns = qMax(columns, 1);
+
+	page.widget = new QWidget(this);
+	QGridLayout *layout = new QGridLayout(page.widget);
+	layout->setMargin(0);
+	layout->setSpacing(1);
+	layout->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+
+	page.items.reserve(page.colors.size());
+	for (int i = 0; i < page.colors.size(); ++i) {
+		ColorPickerItem *item = new ColorPickerItem(page.colors.at(i), i < page.texts.size() ? page.texts.at(i) : QString(), page.widget);
+		connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+		connect(item, SIGNAL(hovered()), SLOT(itemHovered()));
+		layout->addWidget(item, i / columns, i % columns);
+		page.items.append(item);
+	}
+
+	grid->addWidget(page.widget, 0, 0, 1, qMax(1, grid->columnCount()));
+}
+
+/*! \internal
+
+Shows \a page, building it on first view. The other pages are only
+hidden: neither they nor the color grid are laid out again.
+*/
+void ColorPickerPopup::pageChanged(int page)
+{
+	for (int i = 0; i < pages.size(); ++i) {
+		if (i != page - 1 && pages.at(i).widget)
+			pages.at(i).widget->hide();
+	}
+
+	const bool gridShown = page == 0;
+	for (int i = 0; i < items.size(); ++i) {
+		if (items.at(i))
+			items.at(i)->setVisible(gridShown && !isFiltered(items.at(i)));
+	}
+	for (int i = 0; i < recentItems.size(); ++i)
+		recentItems.at(i)->setVisible(gridShown);
+
+	if (page > 0 && page <= pages.size()) {
+		Page &current = pages[page - 1];
+		if (!current.widget)
+			buildPage(current);
+		current.widget->show();
+		if (!current.items.isEmpty())
+			current.items.first()->setFocus();
+	} else if (QWidget *first = widgetAt.value(0).value(0)) {
+		first->setFocus();
+	}
+
+	cachedSizeHint = QSize();
+	if (isVisible()) {
+		grid->activate();
+		adjustSize();
+	} else {
+		prepared = false;
+	}
+}
+
+/*! \internal
+
+The entry is cleared once its text has been taken; text that holds
+no color is left for the user to fix.
+*/
+void ColorPickerPopup::entryReturnPressed()
+{
+	if (insertColorText(entry->text()))
+		entry->clear();
+}
+
+/*! \internal
+
+Returns the remapper for the current grid colors, rebuilding its
+lookup table only if the grid changed since the last call.
+*/
+QtPaletteRemapper ColorPickerPopup::remapper() const
+{
+	return paletteModel.remapper();
+}
+
+/*! \internal
+
+Returns a snapshot of the palette, safe to hand over to another
+thread.
+*/
+QtColorPalette ColorPickerPopup::colorPalette() const
+{
+	return paletteModel;
+}
+
+/*! \internal
+
+Returns a number that changes with every change to the grid entries.
+*/
+int ColorPickerPopup::paletteRevision() const
+{
+	return paletteModel.version();
+}
+
+/*! \internal
+
+Sorts the palette and moves the items to follow it.
+*/
+void ColorPickerPopup::sortColors(QtColorPalette::SortKey key)
+{
+	const QVector<int> order = paletteModel.sort(key);
+
+	QList<ColorPickerItem *> sorted;
+	sorted.reserve(order.size());
+	for (int i = 0; i < order.size(); ++i)
+		sorted.append(items.at(order.at(i)));
+	if (sorted == items)
 		return;
-	}
 
-	ColorPickerItem *item = new ColorPickerItem(col, text, this);
+	items = sorted;
+	++paletteVersion;
+	regenerateGrid();
+	update();
+}
 
-	if (lastSelectedItem) {
-		lastSelectedItem->setSelected(false);
-	}
-	else {
-		item->setSelected(true);
-		lastSel = col;
-	}
-	item->setFocus();
+/*! \internal
 
-	connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+Marks \a item, and its palette entry, as a custom color.
+*/
+void ColorPickerPopup::setCustom(ColorPickerItem *item, bool custom)
+{
+	item->setCustom(custom);
+	paletteModel.setCustom(items.indexOf(item), custom);
+}
 
-	if (index == -1)
-		index = items.count();
+/*! \internal
+
+*/
+void ColorPickerPopup::setRecentColors(QtRecentColors *store)
+{
+	if (recentStore == store)
+		return;
+
+	if (recentStore)
+		disconnect(recentStore, 0, this, 0);
+	recentStore = store;
+	if (recentStore)
+		connect(recentStore, SIGNAL(changed()), SLOT(recentColorsChanged()));
+
+	recentColorsChanged();
+}
+
+/*! \internal
+
+The field is created on first use and laid out across the whole
+width of the grid, below the "..." button.
+*/
+void ColorPickerPopup::setColorFieldEnabled(bool enabled)
+{
+	if (enabled == (field != 0))
+		return;
 
-	items.insert((unsigned int)index, item);
+	if (enabled) {
+		field = new QtColorField(this, withAlpha);
+		field->setColor(lastSel.isValid() ? lastSel : QColor(Qt::white));
+		connect(field, SIGNAL(colorChanged(const QColor &)), SLOT(fieldColorChanged(const QColor &)));
+		connect(field, SIGNAL(colorSelected(const QColor &)), SLOT(addCustomColor(const QColor &)));
+	} else {
+		delete field;
+		field = 0;
+	}
 	regenerateGrid();
+}
 
-	update();
+/*! \internal
+
+*/
+QtColorField *ColorPickerPopup::colorField() const
+{
+	return field;
 }
 
 /*! \internal
 
+Dragging in the color field goes through the same per-frame preview
+as browsing the grid.
 */
-QColor ColorPickerPopup::color(int index) const
+void ColorPickerPopup::fieldColorChanged(const QColor &col)
+{
+	pendingPreview = col;
+	if (!previewTimer->isActive())
+		previewTimer->start();
+}
+
+/*! \internal
+
+*/
+QtRecentColors *ColorPickerPopup::recentColors() const
+{
+	return recentStore;
+}
+
+/*! \internal
+
+Marks the recent colors row out of date. A hidden popup defers the
+update to its next showEvent(), so a change in the store costs
+nothing to popups that are not open.
+*/
+void ColorPickerPopup::recentColorsChanged()
+{
+	recentDirty = true;
+	if (isVisible())
+		updateRecentItems();
+}
+
+/*! \internal
+
+Brings the recent colors row in line with the store. Existing items
+are recolored in place; the grid is only laid out again when the
+number of items changes.
+*/
+void ColorPickerPopup::updateRecentItems()
 {
-	if (index < 0 || index > (int) items.count() - 1)
-		return QColor();
+	recentDirty = false;
+
+	const QList<QColor> colors = recentStore ? recentStore->colors() : QList<QColor>();
+	const int previousCount = recentItems.size();
+
+	while (recentItems.size() > colors.size()) {
+		if (recentItems.last() == selectedItem)
+			selectedItem = 0;
+		delete recentItems.takeLast();
+	}
+
+	for (int i = 0; i < colors.size(); ++i) {
+		if (i < recentItems.size()) {
+			if (recentItems.at(i)->color() != colors.at(i))
+				recentItems.at(i)->setColor(colors.at(i), tr("Custom"));
+		} else {
+			ColorPickerItem *item = new ColorPickerItem(colors.at(i), tr("Custom"), this);
+			connect(item, SIGNAL(selected()), SLOT(updateSelected()));
+			connect(item, SIGNAL(hovered()), SLOT(itemHovered()));
+			recentItems.append(item);
+		}
+		if (colors.at(i) == lastSel && !find(lastSel))
+			select(recentItems.at(i));
+		else if (recentItems.at(i) == selectedItem)
+			select(0);
+	}
+
+	if (recentItems.size() != previousCount)
+		regenerateGrid();
+}
 
-	ColorPickerPopup *that = (ColorPickerPopup *)this;
-	return that->items.at(index)->color();
+/*! \internal
+
+*/
+QColor ColorPickerPopup::color(int index) const
+{
+	return paletteModel.color(index);
 }
 
 /*! \internal
@@ -602,20 +2244,9 @@ void ColorPickerPopup::exec()
 */
 void ColorPickerPopup::updateSelected()
 {
-	QLayoutItem *layoutItem;
-	int i = 0;
-	while ((layoutItem = grid->itemAt(i)) != 0) {
-		QWidget *w = layoutItem->widget();
-		if (w && w->inherits("ColorPickerItem")) {
-			ColorPickerItem *litem = reinterpret_cast<ColorPickerItem *>(layoutItem->widget());
-			if (litem != sender())
-				litem->setSelected(false);
-		}
-		++i;
-	}
-
 	if (sender() && sender()->inherits("ColorPickerItem")) {
 		ColorPickerItem *item = (ColorPickerItem *)sender();
+		select(item);
 		lastSel = item->color();
 		emit selected(item->color());
 	}
@@ -639,6 +2270,43 @@ Controls keyboard navigation and selection on the color grid.
 */
 void ColorPickerPopup::keyPressEvent(QKeyEvent *e)
 {
+	if (e->matches(QKeySequence::Paste)) {
+		insertColorText(QApplication::clipboard()->text());
+		return;
+	}
+
+	// The entry lets Return through once it has taken the text; it
+	// must not also pick the grid item under the keyboard focus.
+	if (entry && entry->hasFocus() && e->key() != Qt::Key_Escape)
+		return;
+
+	// Added pages are browsed with Tab; the arrow keys below only
+	// know the color grid.
+	if (currentPage() > 0) {
+		ColorPickerItem *item = qobject_cast<ColorPickerItem *>(focusWidget());
+		switch (e->key()) {
+		case Qt::Key_Space:
+		case Qt::Key_Return:
+		case Qt::Key_Enter:
+			if (item) {
+				select(item);
+				lastSel = item->color();
+				emit selected(item->color());
+				if (isPopup)
+					hide();
+			}
+			break;
+		case Qt::Key_Escape:
+			if (isPopup)
+				hide();
+			break;
+		default:
+			e->ignore();
+			break;
+		}
+		return;
+	}
+
 	int curRow = 0;
 	int curCol = 0;
 
@@ -687,20 +2355,7 @@ void ColorPickerPopup::keyPressEvent(QKeyEvent *e)
 		QWidget *w = widgetAt[curRow][curCol];
 		if (w && w->inherits("ColorPickerItem")) {
 			ColorPickerItem *wi = reinterpret_cast<ColorPickerItem *>(w);
-			wi->setSelected(true);
-
-			QLayoutItem *layoutItem;
-			int i = 0;
-			while ((layoutItem = grid->itemAt(i)) != 0) {
-				QWidget *w = layoutItem->widget();
-				if (w && w->inherits("ColorPickerItem")) {
-					ColorPickerItem *litem
-						= reinterpret_cast<ColorPickerItem *>(layoutItem->widget());
-					if (litem != wi)
-						litem->setSelected(false);
-				}
-				++i;
-			}
+			select(wi);
 
 			lastSel = wi->color();
 			emit selected(wi->color());
@@ -755,12 +2410,57 @@ void ColorPickerPopup::hideEvent(QHideEvent *e)
 
 	setFocus();
 
+	previewTimer->stop();
+	if (previewActive) {
+		previewActive = false;
+		emit previewEnded();
+	}
+
 	emit hid();
 	QFrame::hideEvent(e);
 }
 
 /*! \internal
 
+Records the color of the hovered or focused item and schedules its
+preview. The timer is not restarted while it runs, so a stream of
+hover events yields one previewed() per frame with the latest color.
+*/
+void ColorPickerPopup::itemHovered()
+{
+	if (!sender() || !sender()->inherits("ColorPickerItem"))
+		return;
+
+	ColorPickerItem *item = (ColorPickerItem *)sender();
+	pendingPreview = item->color();
+	// Browsing the derived rows must not move them.
+	if (!derived.isEmpty() && !isDerived(item))
+		pendingBase = item->color();
+	if (!previewTimer->isActive())
+		previewTimer->start();
+}
+
+/*! \internal
+
+*/
+void ColorPickerPopup::emitPreview()
+{
+	if (pendingBase.isValid()) {
+		updateDerivedRows(pendingBase);
+		pendingBase = QColor();
+	}
+
+	const bool dropping = dropper && dropper->isActive();
+	if ((!isVisible() && !dropping) || !pendingPreview.isValid() || pendingPreview == lastPreview)
+		return;
+
+	lastPreview = pendingPreview;
+	previewActive = true;
+	emit previewed(lastPreview);
+}
+
+/*! \internal
+
 */
 QColor ColorPickerPopup::lastSelected() const
 {
@@ -774,25 +2474,41 @@ focusRect and selection rect.
 */
 void ColorPickerPopup::showEvent(QShowEvent *)
 {
-	bool foundSelected = false;
-	for (int i = 0; i < grid->columnCount(); ++i) {
-		for (int j = 0; j < grid->rowCount(); ++j) {
-			QWidget *w = widgetAt[j][i];
-			if (w && w->inherits("ColorPickerItem")) {
-				if (((ColorPickerItem *)w)->isSelected()) {
-					w->setFocus();
-					foundSelected = true;
-					break;
-				}
-			}
+	// Colors picked in other processes since the last show.
+	if (recentStore && recentStore->refresh())
+		recentDirty = true;
+	if (recentDirty)
+		updateRecentItems();
+	if (markedVersion != paletteVersion)
+		updateContrastMarks();
+
+	if (field && lastSel.isValid())
+		field->setColor(lastSel);
+	updateDerivedRows(lastSel.isValid() ? lastSel : color(0));
+
+	// Previews are paced to the refresh rate of the screen we show on.
+	if (windowHandle() && windowHandle()->screen() && windowHandle()->screen()->refreshRate() > 0)
+		previewTimer->setInterval(qMax(1, qRound(1000.0 / windowHandle()->screen()->refreshRate())));
+
+	if (selectedItem && selectedItem->isSelected() && selectedItem->isVisibleTo(this)) {
+		// Focusing the selected item is not browsing: don't preview it.
+		lastPreview = selectedItem->color();
+		selectedItem->setFocus();
+	} else if (currentPage() > 0) {
+		const Page &page = pages.at(currentPage() - 1);
+		if (page.items.isEmpty())
+			setFocus();
+		else {
+			lastPreview = page.items.first()->color();
+			page.items.first()->setFocus();
 		}
-	}
-
-	if (!foundSelected) {
+	} else {
 		if (items.count() == 0)
 			setFocus();
-		else
+		else {
+			lastPreview = items.at(0)->color();
 			widgetAt[0][0]->setFocus();
+		}
 	}
 }
 
@@ -806,6 +2522,7 @@ void ColorPickerPopup::regenerateGrid()
 	int columns = cols;
 	if (columns == -1)
 		columns = (int) ceil(sqrt((float) items.count()));
+	columns = qMax(columns, 1);
 
 	// When the number of columns grows, the number of rows will
 	// fall. There's no way to shrink a grid, so we create a new
@@ -817,7 +2534,11 @@ void ColorPickerPopup::regenerateGrid()
 
 	int ccol = 0, crow = 0;
 	for (int i = 0; i < items.size(); ++i) {
-		if (items.at(i)) {
+		if (items.at(i) && isFiltered(items.at(i))) {
+			items.at(i)->hide();
+		} else if (items.at(i)) {
+			if (items.at(i)->isHidden() && currentPage() == 0)
+				items.at(i)->show();
 			widgetAt[crow][ccol] = items.at(i);
 			grid->addWidget(items.at(i), crow, ccol++);
 			if (ccol == columns) {
@@ -827,10 +2548,85 @@ void ColorPickerPopup::regenerateGrid()
 		}
 	}
 
+	// Recent colors start on a row of their own.
+	if (!recentItems.isEmpty()) {
+		if (ccol != 0) {
+			++crow;
+			ccol = 0;
+		}
+		for (int i = 0; i < recentItems.size(); ++i) {
+			widgetAt[crow][ccol] = recentItems.at(i);
+			grid->addWidget(recentItems.at(i), crow, ccol++);
+			if (ccol == columns) {
+				++crow;
+				ccol = 0;
+			}
+		}
+	}
+
+	// Each derived row starts a row of its own.
+	for (int r = 0; r < derived.size(); ++r) {
+		if (ccol != 0) {
+			++crow;
+			ccol = 0;
+		}
+		const QList<ColorPickerItem *> &row = derived.at(r).items;
+		for (int i = 0; i < row.size(); ++i) {
+			widgetAt[crow][ccol] = row.at(i);
+			grid->addWidget(row.at(i), crow, ccol++);
+			if (ccol == columns) {
+				++crow;
+				ccol = 0;
+			}
+		}
+	}
+
 	if (moreButton) {
 		grid->addWidget(moreButton, crow, ccol);
 		widgetAt[crow][ccol] = moreButton;
 	}
+
+	if (dropperButton) {
+		if (moreButton && ++ccol == columns) {
+			++crow;
+			ccol = 0;
+		}
+		grid->addWidget(dropperButton, crow, ccol);
+		widgetAt[crow][ccol] = dropperButton;
+	}
+
+	if (field) {
+		if (moreButton || dropperButton || ccol != 0)
+			++crow;
+		grid->addWidget(field, crow, 0, 1, columns);
+	}
+
+	if (entry) {
+		if (field || moreButton || dropperButton || ccol != 0)
+			++crow;
+		grid->addWidget(entry, crow, 0, 1, columns);
+	}
+
+	// Built pages go back over the first row, and items added while
+	// another page is shown stay hidden.
+	if (pageBar) {
+		grid->setMenuBar(pageBar);
+		for (int i = 0; i < pages.size(); ++i) {
+			if (pages.at(i).widget)
+				grid->addWidget(pages.at(i).widget, 0, 0, 1, columns);
+		}
+		if (pageBar->currentIndex() > 0) {
+			for (int i = 0; i < items.size(); ++i) {
+				if (items.at(i))
+					items.at(i)->hide();
+			}
+			for (int i = 0; i < recentItems.size(); ++i)
+				recentItems.at(i)->hide();
+		}
+	}
+
+	cachedSizeHint = QSize();
+	prepared = false;
 	updateGeometry();
 }
 
@@ -849,7 +2645,31 @@ void ColorPickerPopup::getColorFromDialog()
 	if (!col.isValid())
 		return;
 
-	insertColor(col, tr("Custom"), -1);
+	addCustomColor(col);
+}
+
+/*! \internal
+
+Makes \a col, picked in the dialog or in the color field, the
+selected color. It is added to the grid as a custom color, or
+published to the recent colors store if there is one.
+*/
+void ColorPickerPopup::addCustomColor(const QColor &col)
+{
+	// Match existing swatches the same way QtColorPicker::setCurrentColor
+	// does, so a dialog pick and a programmatic one land on the same item.
+	ColorPickerItem *item = findSimilar(col);
+	if (!item)
+		item = findPicked(col);
+	if (item) {
+		select(item);
+	} else if (recentStore) {
+		recentStore->publish(col);
+	} else {
+		insertColor(col, tr("Custom"), -1);
+		if ((item = findSimilar(col)))
+			setCustom(item, true);
+	}
 	lastSel = col;
 	emit selected(col);
 }
@@ -860,10 +2680,27 @@ whose name is set to \a text.
 */
 ColorPickerItem::ColorPickerItem(const QColor &color, const QString &text,
 								 QWidget *parent)
-								 : QToolButton(parent), c(color), t(text), sel(false)
+								 : QToolButton(parent), c(color), t(text), context(0), key(0), translated(true),
+								 sel(false), custom(false), lowContrast(false)
 {
 	setToolTip(t);
-	SetStyleSheet(c);
+	setAttribute(Qt::WA_Hover);
+	setFixedHeight(22);
+	setFixedWidth(22);
+	setObjectName("ColorPickerItem");
+}
+
+/*!
+Constructs a ColorPickerItem whose color is set to \a color, and
+whose name is \a key translated in \a context. The name is only
+translated when it is first needed, usually for the tooltip.
+*/
+ColorPickerItem::ColorPickerItem(const QColor &color, const char *context, const char *key,
+								 QWidget *parent)
+								 : QToolButton(parent), c(color), context(context), key(key), translated(key == 0),
+								 sel(false), custom(false), lowContrast(false)
+{
+	setAttribute(Qt::WA_Hover);
 	setFixedHeight(22);
 	setFixedWidth(22);
 	setObjectName("ColorPickerItem");
@@ -886,6 +2723,74 @@ QColor ColorPickerItem::color() const
 	return c;
 }
 
+/*!
+Returns the item's name.
+*/
+QString ColorPickerItem::name() const
+{
+	if (!translated) {
+		t = QCoreApplication::translate(context, key);
+		translated = true;
+	}
+	return t;
+}
+
+/*!
+Returns the context the item's name is translated in, or 0 if the
+name was given already translated.
+*/
+const char *ColorPickerItem::nameContext() const
+{
+	return key ? context : 0;
+}
+
+/*!
+Returns the untranslated name of the item, or 0 if the name was
+given already translated.
+*/
+const char *ColorPickerItem::nameKey() const
+{
+	return key;
+}
+
+/*!
+Returns true if the item holds a custom color, one that the user
+picked rather than one of the palette colors.
+*/
+bool ColorPickerItem::isCustom() const
+{
+	return custom;
+}
+
+/*!
+
+*/
+void ColorPickerItem::setCustom(bool isCustom)
+{
+	custom = isCustom;
+}
+
+/*!
+Returns true if the item is marked as failing the minimum contrast
+of the popup.
+*/
+bool ColorPickerItem::isLowContrast() const
+{
+	return lowContrast;
+}
+
+/*!
+
+*/
+void ColorPickerItem::setLowContrast(bool low)
+{
+	if (lowContrast == low)
+		return;
+
+	lowContrast = low;
+	update();
+}
+
 /*!
 
 */
@@ -910,32 +2815,59 @@ void ColorPickerItem::setColor(const QColor &color, const QString &text)
 {
 	c = color;
 	t = text;
+	key = 0;
+	translated = true;
 	setToolTip(t);
 	update();
-
-	SetStyleSheet(c);
 }
 
-void ColorPickerItem::SetStyleSheet(const QColor& iColor)
+/*!
+Items named from a QtPaletteTable set their tooltip when it is first
+requested.
+*/
+bool ColorPickerItem::event(QEvent *e)
 {
-	setStyleSheet(
-		QString("ColorPickerItem {"
-		"border-width: 1px;"
-		"border-color: #5c5c5c;"
-		"border-style: solid;"
-		"border-radius: 2px;"
-		"background-color: %1"
-		"}"
+	if (e->type() == QEvent::ToolTip && key)
+		setToolTip(name());
+	return QToolButton::event(e);
+}
 
-		"ColorPickerItem:hover {"
-		"border-color: #7EB4EA;"
-		"}"
+/*!
+Translates the name again when the language changes.
+*/
+void ColorPickerItem::changeEvent(QEvent *e)
+{
+	if (e->type() == QEvent::LanguageChange && key)
+		translated = false;
+	QToolButton::changeEvent(e);
+}
 
-		"ColorPickerItem:focus {"
-		"border-color: #000000;"
-		"border-radius: 1px;"
-		"}"
-		).arg(iColor.name()));
+/*!
+Items are not styled: each state is a tile of the process wide
+QtSwatchCache, so that all the popups showing the same colors share
+one rendering and repainting a grid is a series of blits. Items that
+fail the popup's minimum contrast get a stroke over them.
+*/
+void ColorPickerItem::paintEvent(QPaintEvent *)
+{
+	QtSwatchCache::State state = QtSwatchCache::Normal;
+	if (sel)
+		state = QtSwatchCache::Selected;
+	else if (hasFocus())
+		state = QtSwatchCache::Focus;
+	else if (underMouse())
+		state = QtSwatchCache::Hover;
+
+	QPainter p(this);
+	QtSwatchCache::paint(&p, rect(), c, state);
+
+	// Low contrast colors are struck through, in whichever of
+	// black and white stands out on them.
+	if (lowContrast) {
+		p.setRenderHint(QPainter::Antialiasing);
+		p.setPen(QPen(QtColorSpace::relativeLuminance(c.rgb()) > 0.18f ? Qt::black : Qt::white, 1.5));
+		p.drawLine(QPointF(3, height() - 3), QPointF(width() - 3, 3));
+	}
 }
 
 /*!
@@ -948,6 +2880,24 @@ void ColorPickerItem::mouseReleaseEvent(QMouseEvent *event)
 	emit selected();
 }
 
+/*!
+Emits hovered() when the mouse enters the item.
+*/
+void ColorPickerItem::enterEvent(QEvent *e)
+{
+	QToolButton::enterEvent(e);
+	emit hovered();
+}
+
+/*!
+Emits hovered() when the item gets the focus by keyboard navigation.
+*/
+void ColorPickerItem::focusInEvent(QFocusEvent *e)
+{
+	QToolButton::focusInEvent(e);
+	emit hovered();
+}
+
 /*!
 
 */
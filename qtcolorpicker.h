@@ -52,15 +52,33 @@
 #define QTCOLORPICKER_H
 #include <QtWidgets/QPushButton>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtGui/QColor>
 
 #include <QtWidgets/QLabel>
 #include <QtCore/QEvent>
 #include <QtCore/QEventLoop>
+#include <QtCore/QDataStream>
+#include <QtCore/QHash>
+#include <QtCore/QTimer>
 #include <QtGui/QFocusEvent>
 #include <QtWidgets/QGridLayout>
+#include <QtWidgets/QLineEdit>
+#include <QtWidgets/QTabBar>
 #include <QtWidgets/QToolButton>
 
+#include "qtcolorfield.h"
+#include "qtcolormap.h"
+#include "qtcolorpalette.h"
+#include "qtcolorparser.h"
+#include "qtpalettefile.h"
+#include "qtcolorspace.h"
+#include "qteyedropper.h"
+#include "qtpaletteremapper.h"
+#include "qtpalettetable.h"
+#include "qtrecentcolors.h"
+#include "qtswatchcache.h"
+
 #define QtPublicCtrlDLL
 
 class ColorPickerPopup;
@@ -70,22 +88,77 @@ class QtColorPicker : public QPushButton
     Q_OBJECT
 
     Q_PROPERTY(bool colorDialog READ colorDialogEnabled WRITE setColorDialogEnabled)
+    Q_PROPERTY(bool sharedRecentColors READ sharedRecentColors WRITE setSharedRecentColors)
 
 public:
+    enum DerivedRow {
+        TintRow = 0x01,
+        ShadeRow = 0x02,
+        ComplementaryRow = 0x04,
+        TriadicRow = 0x08,
+        AnalogousRow = 0x10
+    };
+
     QtColorPicker(QWidget *parent = 0,
                   int columns = -1, bool enableColorDialog = true);
 
     ~QtColorPicker();
 
     void insertColor(const QColor &color, const QString &text = QString::null, int index = -1);
+    void insertColors(const QList<QColor> &colors, const QStringList &texts = QStringList());
+    void insertPalette(const QtPaletteTable &table);
+    int insertColorText(const QString &text);
+    void removeColor(int index);
+
+    void setPaletteFile(const QString &fileName);
+    QString paletteFile() const;
+
+    int addPalettePage(const QString &title, const QList<QColor> &colors, const QStringList &texts = QStringList());
+    int palettePageCount() const;
+    void setCurrentPalettePage(int page);
+    int currentPalettePage() const;
 
     QColor currentColor() const;
 
     QColor color(int index) const;
+    QtPaletteRemapper paletteRemapper() const;
+    QtColorPalette colorPalette() const;
+    void sortColors(QtColorPalette::SortKey key);
+
+    void setColorMap(const QtColorMap &map, int steps = 16);
+    QtColorMap colorMap() const;
 
     void setColorDialogEnabled(bool enabled);
     bool colorDialogEnabled() const;
 
+    void setColorTolerance(qreal deltaE);
+    qreal colorTolerance() const;
+
+    void setDerivedRows(int rows);
+    int derivedRows() const;
+
+    void setContrastReferences(const QList<QColor> &references);
+    QList<QColor> contrastReferences() const;
+    void setMinimumContrast(qreal ratio, bool hideFailing = false);
+    qreal minimumContrast() const;
+    QVector<float> contrastRatios() const;
+
+    void setSharedRecentColors(bool enabled);
+    bool sharedRecentColors() const;
+
+    void setColorFieldEnabled(bool enabled);
+    bool colorFieldEnabled() const;
+
+    void setColorEntryEnabled(bool enabled);
+    bool colorEntryEnabled() const;
+
+    void setEyedropperEnabled(bool enabled);
+    bool eyedropperEnabled() const;
+    void setPixelSource(QtPixelSource *source);
+
+    QByteArray saveState() const;
+    bool restoreState(const QByteArray &state);
+
     void setStandardColors();
 	void setColorsWithoutText();
 
@@ -96,16 +169,25 @@ public Q_SLOTS:
 
 Q_SIGNALS:
     void colorChanged(const QColor &);
+    void colorPreviewed(const QColor &);
 
 protected:
     void paintEvent(QPaintEvent *e);
+    void keyPressEvent(QKeyEvent *e);
+    void enterEvent(QEvent *e);
+    void focusInEvent(QFocusEvent *e);
 
 private Q_SLOTS:
     void buttonPressed(bool toggled);
     void popupClosed();
+    void previewEnded();
+    void paletteFileLoaded();
 
 private:
     ColorPickerPopup *popup;
+    QtPaletteFile *paletteSource;
+    QtColorMap mapSource;
+    int mapRevision;
     QColor col;
     bool withColorDialog;
     bool dirty;
@@ -137,29 +219,48 @@ class QtPublicCtrlDLL ColorPickerItem : public QToolButton
 public:
     ColorPickerItem(const QColor &color = Qt::white, const QString &text = QString::null,
 		      QWidget *parent = 0);
+    ColorPickerItem(const QColor &color, const char *context, const char *key, QWidget *parent);
     ~ColorPickerItem();
 
     QColor color() const;
+    QString name() const;
 
     void setSelected(bool);
     bool isSelected() const;
+
+    void setCustom(bool);
+    bool isCustom() const;
+
+    void setLowContrast(bool);
+    bool isLowContrast() const;
+
+    const char *nameContext() const;
+    const char *nameKey() const;
 signals:
     void clicked();
     void selected();
+    void hovered();
 
 public slots:
     void setColor(const QColor &color, const QString &text = QString());
 
 protected:
+    void paintEvent(QPaintEvent *e);
+    bool event(QEvent *e);
+    void changeEvent(QEvent *e);
     void mouseReleaseEvent(QMouseEvent *e);
-
-private:
-	void SetStyleSheet(const QColor& iColor);
+    void enterEvent(QEvent *e);
+    void focusInEvent(QFocusEvent *e);
 
 private:
     QColor c;
-    QString t;
+    mutable QString t;
+    const char *context;
+    const char *key;
+    mutable bool translated;
     bool sel;
+    bool custom;
+    bool lowContrast;
 };
 
 /*
@@ -182,6 +283,11 @@ public:
     ~ColorPickerPopup();
 
     void insertColor(const QColor &col, const QString &text, int index);
+    void insertColors(const QList<QColor> &colors, const QStringList &texts);
+    void insertPalette(const QtPaletteTable &table);
+    int insertColorText(const QString &text);
+    void removeColor(int index);
+    void applyPalette(const QList<QColor> &colors, const QStringList &texts);
     void exec();
 
     void setExecFlag();
@@ -189,10 +295,84 @@ public:
     QColor lastSelected() const;
 
     ColorPickerItem *find(const QColor &col) const;
+    ColorPickerItem *findSimilar(const QColor &col) const;
+    ColorPickerItem *findPicked(const QColor &col) const;
     QColor color(int index) const;
 
+    void select(ColorPickerItem *item);
+    void prepare();
+    QSize sizeHint() const;
+
+    void saveState(QDataStream &stream) const;
+    bool restoreState(QDataStream &stream);
+
+    /// @brief
+    /// Colors closer than \a deltaE (CIE76) to an existing entry are folded into it
+    /// instead of being inserted. 0 only rejects exact duplicates.
+    void setColorTolerance(qreal deltaE);
+    qreal colorTolerance() const;
+
+    QtPaletteRemapper remapper() const;
+
+    /// @brief
+    /// The entries of the grid, in order. The items are a view of this palette: every change
+    /// to the grid goes through it, and it answers all the lookups.
+    QtColorPalette colorPalette() const;
+    int paletteRevision() const;
+    void sortColors(QtColorPalette::SortKey key);
+    void setCustom(ColorPickerItem *item, bool custom);
+
+    /// @brief
+    /// Shows the QtColorPicker::DerivedRow rows in \a rows below the grid, generated from the
+    /// grid color under the mouse or the focus
+    void setDerivedRows(int rows);
+    int derivedRows() const;
+
+    /// @brief
+    /// Marks, or hides if \a hideFailing, the grid colors whose WCAG contrast against one of the
+    /// references is below \a ratio. The ratios are computed in one batch per palette version.
+    void setContrastReferences(const QList<QColor> &references);
+    QList<QColor> contrastReferences() const;
+    void setMinimumContrast(qreal ratio, bool hideFailing);
+    qreal minimumContrast() const;
+    QVector<float> contrastRatios() const;
+
+    /// @brief
+    /// Shows the colors of \a store in a row below the grid and publishes the custom colors
+    /// picked in the dialog to it instead of inserting them. 0 detaches the popup.
+    void setRecentColors(QtRecentColors *store);
+    QtRecentColors *recentColors() const;
+
+    /// @brief
+    /// Embeds a QtColorField below the grid, to pick custom colors without the modal dialog
+    void setColorFieldEnabled(bool enabled);
+    QtColorField *colorField() const;
+
+    /// @brief
+    /// Adds a line edit below the grid where colors can be typed as hex, rgb(), hsl() or names
+    void setColorEntryEnabled(bool enabled);
+    QLineEdit *colorEntry() const;
+
+    /// @brief
+    /// Adds a button next to the "..." one that picks a color from anywhere on the screen.
+    /// \a source replaces the screens as the place pixels are read from, 0 restores them.
+    void setEyedropperEnabled(bool enabled);
+    bool eyedropperEnabled() const;
+    void setPixelSource(QtPixelSource *source);
+
+    /// @brief
+    /// Adds a named page of colors, shown in a tab bar above the grid. Page 0 is the grid itself.
+    /// The items of a page are only created the first time the page is shown.
+    int addPage(const QString &title, const QList<QColor> &colors, const QStringList &texts);
+    int pageCount() const;
+    void setPageTitle(int page, const QString &title);
+    void setCurrentPage(int page);
+    int currentPage() const;
+
 signals:
     void selected(const QColor &);
+    void previewed(const QColor &);
+    void previewEnded();
     void hid();
 
 public slots:
@@ -200,20 +380,62 @@ public slots:
 
 protected slots:
     void updateSelected();
+    void recentColorsChanged();
+    void itemHovered();
+    void emitPreview();
+    void fieldColorChanged(const QColor &col);
+    void addCustomColor(const QColor &col);
+    void entryReturnPressed();
+    void pageChanged(int page);
+    void startEyedropper();
+    void eyedropperFinished();
 
 protected:
     void keyPressEvent(QKeyEvent *e);
     void showEvent(QShowEvent *e);
     void hideEvent(QHideEvent *e);
     void mouseReleaseEvent(QMouseEvent *e);
+    void changeEvent(QEvent *e);
 
     void regenerateGrid();
 
 private:
+    struct DerivedItems
+    {
+        int kind;
+        QList<ColorPickerItem *> items;
+    };
+
+    struct Page
+    {
+        QString title;
+        QList<QColor> colors;
+        QStringList texts;
+        QWidget *widget;
+        QList<ColorPickerItem *> items;
+    };
+
+    void appendItem(ColorPickerItem *item, bool &hasSelection);
+    void updateRecentItems();
+    void buildPage(Page &page);
+    void updateContrastMarks(bool forceLayout = false);
+    void updateDerivedRows(const QColor &base);
+    QVector<QRgb> derivedRamp(int kind, QRgb base);
+    bool isDerived(const ColorPickerItem *item) const;
+    bool isFiltered(const ColorPickerItem *item) const;
+
     QMap<int, QMap<int, QWidget *> > widgetAt;
     QList<ColorPickerItem *> items;
+    QList<ColorPickerItem *> recentItems;
     QGridLayout *grid;
     ColorPickerButton *moreButton;
+    ColorPickerButton *dropperButton;
+    QtEyedropper *dropper;
+    QtPixelSource *pixelSource;
+    QtColorField *field;
+    QLineEdit *entry;
+    QTabBar *pageBar;
+    QList<Page> pages;
     QEventLoop *eventLoop;
 
 	bool isPopup;
@@ -221,6 +443,28 @@ private:
     int lastPos;
     int cols;
     QColor lastSel;
+    QtColorPalette paletteModel;
+    int paletteVersion;
+    QtRecentColors *recentStore;
+    bool recentDirty;
+    ColorPickerItem *selectedItem;
+    mutable QSize cachedSizeHint;
+    bool prepared;
+    int derivedKinds;
+    QList<DerivedItems> derived;
+    QColor derivedBase;
+    QColor pendingBase;
+    QHash<quint64, QVector<QRgb> > rampCache;
+    QList<QColor> contrastRefs;
+    qreal minContrast;
+    bool hideLowContrast;
+    mutable QVector<float> cachedContrast;
+    mutable int contrastVersion;
+    int markedVersion;
+    QTimer *previewTimer;
+    QColor pendingPreview;
+    QColor lastPreview;
+    bool previewActive;
 };
 
 #endif
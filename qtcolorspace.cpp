@@ -0,0 +1,250 @@
+#include <math.h>
+#include <QtCore/QVarLengthArray>
+
+#include "qtcolorspace.h"
+
+/*! \internal
+
+Lookup tables for the sRGB transfer function. The forward direction
+has only 256 inputs; the inverse is sampled finely enough that the
+rounding error stays below half an 8 bit step.
+*/
+struct QtSrgbTables
+{
+	enum { InverseSize = 4096 };
+
+	float toLinear[256];
+	uchar fromLinear[InverseSize + 1];
+
+	QtSrgbTables()
+	{
+		for (int i = 0; i < 256; ++i) {
+			const float c = i / 255.0f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i <= InverseSize; ++i) {
+			const float l = i / float(InverseSize);
+			const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+			fromLinear[i] = uchar(qBound(0, int(c * 255.0f + 0.5f), 255));
+		}
+	}
+};
+
+static const QtSrgbTables &srgbTables()
+{
+	static const QtSrgbTables tables;
+	return tables;
+}
+
+/*!
+Returns the linear light value in [0, 1] of the 8 bit sRGB
+\a component.
+*/
+float QtColorSpace::toLinear(int component)
+{
+	return srgbTables().toLinear[component & 0xff];
+}
+
+/*!
+Returns the 8 bit sRGB component of the linear light \a value,
+which is clamped to [0, 1].
+*/
+int QtColorSpace::fromLinear(float value)
+{
+	const int i = int(qBound(0.0f, value, 1.0f) * QtSrgbTables::InverseSize + 0.5f);
+	return srgbTables().fromLinear[i];
+}
+
+/*! \internal
+*/
+static inline float labF(float t)
+{
+	return t > 216.0f / 24389.0f ? cbrtf(t) : (24389.0f / 27.0f * t + 16.0f) / 116.0f;
+}
+
+/*!
+Converts \a rgb to CIE 1976 L*a*b* under a D65 white point. The
+alpha channel is ignored.
+*/
+QtLabColor QtColorSpace::toLab(QRgb rgb)
+{
+	const QtSrgbTables &t = srgbTables();
+	const float r = t.toLinear[qRed(rgb)];
+	const float g = t.toLinear[qGreen(rgb)];
+	const float b = t.toLinear[qBlue(rgb)];
+
+	const float fx = labF((0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f);
+	const float fy = labF(0.2126729f * r + 0.7151522f * g + 0.0721750f * b);
+	const float fz = labF((0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f);
+
+	QtLabColor lab;
+	lab.l = 116.0f * fy - 16.0f;
+	lab.a = 500.0f * (fx - fy);
+	lab.b = 200.0f * (fy - fz);
+	return lab;
+}
+
+/*!
+Converts \a rgb to OKLab. The alpha channel is ignored.
+*/
+QtLabColor QtColorSpace::toOklab(QRgb rgb)
+{
+	const QtSrgbTables &t = srgbTables();
+	const float r = t.toLinear[qRed(rgb)];
+	const float g = t.toLinear[qGreen(rgb)];
+	const float b = t.toLinear[qBlue(rgb)];
+
+	const float l = cbrtf(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+	const float m = cbrtf(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+	const float s = cbrtf(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+
+	QtLabColor lab;
+	lab.l = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+	lab.a = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+	lab.b = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+	return lab;
+}
+
+/*!
+Converts the OKLab color \a lab back to sRGB with the given \a alpha.
+Colors outside the sRGB gamut are clipped per channel.
+*/
+QRgb QtColorSpace::fromOklab(const QtLabColor &lab, int alpha)
+{
+	float l = lab.l + 0.3963377774f * lab.a + 0.2158037573f * lab.b;
+	float m = lab.l - 0.1055613458f * lab.a - 0.0638541728f * lab.b;
+	float s = lab.l - 0.0894841775f * lab.a - 1.2914855480f * lab.b;
+	l = l * l * l;
+	m = m * m * m;
+	s = s * s * s;
+
+	return qRgba(fromLinear(4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s),
+		fromLinear(-1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s),
+		fromLinear(-0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s),
+		alpha);
+}
+
+/*!
+Converts the color with the given \a hue in degrees, \a saturation
+and \a value in [0, 1] to sRGB with the given \a alpha. Unlike
+QColor::fromHsvF(), no QColor is built, which matters when filling
+large images.
+*/
+QRgb QtColorSpace::fromHsv(float hue, float saturation, float value, int alpha)
+{
+	float h = fmodf(hue, 360.0f) / 60.0f;
+	if (h < 0)
+		h += 6.0f;
+	const int sector = int(h) % 6;
+	const float f = h - floorf(h);
+	const int p = int(255.0f * value * (1.0f - saturation) + 0.5f);
+	const int q = int(255.0f * value * (1.0f - saturation * f) + 0.5f);
+	const int t = int(255.0f * value * (1.0f - saturation * (1.0f - f)) + 0.5f);
+	const int v = int(255.0f * value + 0.5f);
+
+	switch (sector) {
+	case 0: return qRgba(v, t, p, alpha);
+	case 1: return qRgba(q, v, p, alpha);
+	case 2: return qRgba(p, v, t, alpha);
+	case 3: return qRgba(p, q, v, alpha);
+	case 4: return qRgba(t, p, v, alpha);
+	default: return qRgba(v, p, q, alpha);
+	}
+}
+
+/*!
+Returns the color \a t of the way from \a c1 to \a c2, interpolated in
+OKLab so that the steps of a ramp look even. Alpha is interpolated
+linearly.
+*/
+QRgb QtColorSpace::mixOklab(QRgb c1, QRgb c2, float t)
+{
+	const QtLabColor lab1 = toOklab(c1);
+	const QtLabColor lab2 = toOklab(c2);
+	QtLabColor lab;
+	lab.l = lab1.l + (lab2.l - lab1.l) * t;
+	lab.a = lab1.a + (lab2.a - lab1.a) * t;
+	lab.b = lab1.b + (lab2.b - lab1.b) * t;
+	return fromOklab(lab, qBound(0, int(qAlpha(c1) + (qAlpha(c2) - qAlpha(c1)) * t + 0.5f), 255));
+}
+
+/*!
+Returns \a rgb with its OKLCH hue turned by \a degrees, keeping its
+lightness and chroma, which is what color harmonies are built from.
+Colors that end up outside the sRGB gamut are clipped.
+*/
+QRgb QtColorSpace::rotateHue(QRgb rgb, float degrees)
+{
+	const QtLabColor lab = toOklab(rgb);
+	const float radians = degrees * 3.14159265f / 180.0f;
+	const float c = cosf(radians);
+	const float s = sinf(radians);
+
+	QtLabColor rotated;
+	rotated.l = lab.l;
+	rotated.a = lab.a * c - lab.b * s;
+	rotated.b = lab.a * s + lab.b * c;
+	return fromOklab(rotated, qAlpha(rgb));
+}
+
+/*!
+Returns the Euclidean distance between \a c1 and \a c2. For CIE
+L*a*b* colors this is the CIE 1976 Delta E, where a value around
+2.3 is the smallest difference most observers can tell apart.
+*/
+float QtColorSpace::deltaE(const QtLabColor &c1, const QtLabColor &c2)
+{
+	const float dl = c1.l - c2.l;
+	const float da = c1.a - c2.a;
+	const float db = c1.b - c2.b;
+	return sqrtf(dl * dl + da * da + db * db);
+}
+
+/*!
+Returns the WCAG 2 relative luminance of \a rgb, in [0, 1]. The alpha
+channel is ignored.
+*/
+float QtColorSpace::relativeLuminance(QRgb rgb)
+{
+	const QtSrgbTables &t = srgbTables();
+	return 0.2126f * t.toLinear[qRed(rgb)] + 0.7152f * t.toLinear[qGreen(rgb)] + 0.0722f * t.toLinear[qBlue(rgb)];
+}
+
+/*!
+Returns the WCAG 2 contrast ratio between \a c1 and \a c2, from 1 for
+identical luminances to 21 for black on white. Text needs at least
+4.5, or 3 when large.
+*/
+float QtColorSpace::contrastRatio(QRgb c1, QRgb c2)
+{
+	const float l1 = relativeLuminance(c1);
+	const float l2 = relativeLuminance(c2);
+	return (qMax(l1, l2) + 0.05f) / (qMin(l1, l2) + 0.05f);
+}
+
+/*!
+Computes the contrast ratio of each of the \a count \a colors against
+each of the \a referenceCount \a references, into \a ratios: the
+ratio of colors[i] against references[r] is ratios[r * count + i].
+
+The luminances are looked up once per color, then the ratios are
+computed one reference at a time, in a branch free loop over all the
+colors that the compiler vectorizes.
+*/
+void QtColorSpace::contrastRatios(const QRgb *colors, int count, const QRgb *references, int referenceCount, float *ratios)
+{
+	const QtSrgbTables &t = srgbTables();
+	QVarLengthArray<float, 1024> luminances(count);
+	float *l = luminances.data();
+	for (int i = 0; i < count; ++i)
+		l[i] = 0.2126f * t.toLinear[qRed(colors[i])] + 0.7152f * t.toLinear[qGreen(colors[i])] + 0.0722f * t.toLinear[qBlue(colors[i])];
+
+	for (int r = 0; r < referenceCount; ++r) {
+		const float reference = relativeLuminance(references[r]) + 0.05f;
+		float *out = ratios + r * count;
+		for (int i = 0; i < count; ++i) {
+			const float c = l[i] + 0.05f;
+			out[i] = (c > reference ? c : reference) / (c > reference ? reference : c);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef QTCOLORSPACE_H
+#define QTCOLORSPACE_H
+#include <QtGui/QColor>
+
+#define QtPublicCtrlDLL
+
+/*
+    A color expressed in a Lab-like space: CIE L*a*b* (L in [0, 100])
+    or OKLab (L in [0, 1]) depending on the function that produced it.
+*/
+struct QtLabColor
+{
+    float l;
+    float a;
+    float b;
+};
+
+/*
+    Conversions between sRGB and the perceptual spaces used by the
+    picker to compare and interpolate colors. All functions are
+    reentrant and can be called from any thread.
+*/
+class QtPublicCtrlDLL QtColorSpace
+{
+public:
+    static float toLinear(int component);
+    static int fromLinear(float value);
+
+    static QtLabColor toLab(QRgb rgb);
+    static QtLabColor toOklab(QRgb rgb);
+    static QRgb fromOklab(const QtLabColor &lab, int alpha = 255);
+    static QRgb fromHsv(float hue, float saturation, float value, int alpha = 255);
+
+    static QRgb mixOklab(QRgb c1, QRgb c2, float t);
+    static QRgb rotateHue(QRgb rgb, float degrees);
+
+    static float deltaE(const QtLabColor &c1, const QtLabColor &c2);
+
+    static float relativeLuminance(QRgb rgb);
+    static float contrastRatio(QRgb c1, QRgb c2);
+    static void contrastRatios(const QRgb *colors, int count, const QRgb *references, int referenceCount, float *ratios);
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include <QtCore/QTimer>
+#include <QtGui/QCursor>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QKeyEvent>
+#include <QtGui/QMouseEvent>
+#include <QtGui/QPainter>
+#include <QtGui/QScreen>
+
+#include "qteyedropper.h"
+
+// The magnified region is (2 * Radius + 1) pixels wide, each shown
+// Zoom times larger. The window is kept Offset points away from the
+// cursor, so that it never shows up in its own captures.
+enum { Radius = 7, Zoom = 8, LabelHeight = 20, Offset = 24 };
+
+static QScreen *screenAt(const QPoint &pos)
+{
+	const QList<QScreen *> screens = QGuiApplication::screens();
+	for (int i = 0; i < screens.size(); ++i) {
+		if (screens.at(i)->geometry().contains(pos))
+			return screens.at(i);
+	}
+	return QGuiApplication::primaryScreen();
+}
+
+/*!
+Grabs \a region from the screen holding its center, clipped to that
+screen.
+*/
+QImage QtScreenPixelSource::grab(const QRect &region)
+{
+	QScreen *screen = screenAt(region.center());
+	if (!screen)
+		return QImage();
+
+	const QRect geometry = screen->geometry();
+	return screen->grabWindow(0, region.x() - geometry.x(), region.y() - geometry.y(),
+		region.width(), region.height()).toImage();
+}
+
+/*!
+Constructs a source that reads \a image, its top left pixel being at
+\a origin in global coordinates.
+*/
+QtImagePixelSource::QtImagePixelSource(const QImage &image, const QPoint &origin)
+	: source(image.convertToFormat(QImage::Format_ARGB32)), offset(origin)
+{
+}
+
+/*!
+Returns the part of the image under \a region; pixels outside the
+image are transparent black.
+*/
+QImage QtImagePixelSource::grab(const QRect &region)
+{
+	return source.copy(region.translated(-offset));
+}
+
+/*!
+Constructs an eyedropper reading the screens.
+*/
+QtEyedropper::QtEyedropper(QWidget *parent)
+	: QWidget(parent, Qt::Tool | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint),
+	source(&screenSource)
+{
+	const int side = (2 * Radius + 1) * Zoom;
+	setFixedSize(side, side + LabelHeight);
+	setAttribute(Qt::WA_OpaquePaintEvent);
+
+	pollTimer = new QTimer(this);
+	pollTimer->setInterval(16);
+	connect(pollTimer, SIGNAL(timeout()), SLOT(poll()));
+}
+
+/*!
+Destructs the eyedropper.
+*/
+QtEyedropper::~QtEyedropper()
+{
+}
+
+/*!
+Reads pixels from \a source instead of the screens. The source is
+not owned; 0 goes back to the screens.
+*/
+void QtEyedropper::setPixelSource(QtPixelSource *source)
+{
+	this->source = source ? source : &screenSource;
+}
+
+QtPixelSource *QtEyedropper::pixelSource() const
+{
+	return source == &screenSource ? 0 : source;
+}
+
+/*!
+Returns the color under the cursor.
+*/
+QColor QtEyedropper::color() const
+{
+	return current;
+}
+
+/*!
+Returns true between start() and stop().
+*/
+bool QtEyedropper::isActive() const
+{
+	return pollTimer->isActive();
+}
+
+/*!
+Shows the magnifier and starts following the cursor, at the refresh
+rate of the screen it is on.
+*/
+void QtEyedropper::start()
+{
+	sample = QImage();
+	track(QCursor::pos());
+
+	QScreen *screen = screenAt(QCursor::pos());
+	if (screen && screen->refreshRate() > 0)
+		pollTimer->setInterval(qMax(1, qRound(1000.0 / screen->refreshRate())));
+	pollTimer->start();
+
+	show();
+	raise();
+	grabMouse(Qt::CrossCursor);
+	grabKeyboard();
+}
+
+/*!
+Hides the magnifier and stops following the cursor.
+*/
+void QtEyedropper::stop()
+{
+	pollTimer->stop();
+	releaseMouse();
+	releaseKeyboard();
+	hide();
+}
+
+/*! \internal
+*/
+void QtEyedropper::poll()
+{
+	track(QCursor::pos());
+}
+
+/*!
+Reads the region around \a globalPos and moves the magnifier next to
+it. Nothing is read if the position did not change.
+*/
+void QtEyedropper::track(const QPoint &globalPos)
+{
+	if (globalPos == lastPos && !sample.isNull())
+		return;
+	lastPos = globalPos;
+
+	sample = source->grab(QRect(globalPos - QPoint(Radius, Radius), QSize(2 * Radius + 1, 2 * Radius + 1)));
+	const QColor previous = current;
+	current = sample.isNull() ? QColor() : QColor::fromRgb(sample.pixel(sample.width() / 2, sample.height() / 2));
+
+	// Below right of the cursor, flipped at the edges of the screen.
+	QPoint pos = globalPos + QPoint(Offset, Offset);
+	if (QScreen *screen = screenAt(globalPos)) {
+		const QRect available = screen->availableGeometry();
+		if (pos.x() + width() > available.right() + 1)
+			pos.setX(globalPos.x() - Offset - width());
+		if (pos.y() + height() > available.bottom() + 1)
+			pos.setY(globalPos.y() - Offset - height());
+	}
+	move(pos);
+	update();
+
+	if (current.isValid() && current != previous)
+		emit hovered(current);
+}
+
+/*! \internal
+*/
+void QtEyedropper::paintEvent(QPaintEvent *)
+{
+	QPainter p(this);
+	const int side = (2 * Radius + 1) * Zoom;
+	const QRect zoomed(0, 0, side, side);
+	p.fillRect(rect(), palette().window());
+	if (!sample.isNull())
+		p.drawImage(zoomed, sample);
+
+	// The picked pixel, outlined in both black and white so that it
+	// shows on any color.
+	const QRect center(Radius * Zoom, Radius * Zoom, Zoom, Zoom);
+	p.setPen(Qt::black);
+	p.drawRect(center.adjusted(-1, -1, 0, 0));
+	p.setPen(Qt::white);
+	p.drawRect(center.adjusted(-2, -2, 1, 1));
+
+	const QRect label(0, side, width(), LabelHeight);
+	if (current.isValid()) {
+		p.fillRect(label.adjusted(2, 2, -width() / 2, -2), current);
+		p.setPen(palette().color(QPalette::WindowText));
+		p.drawText(label.adjusted(width() / 2, 0, 0, 0), Qt::AlignCenter, current.name());
+	}
+	p.setPen(QColor("#5c5c5c"));
+	p.drawRect(rect().adjusted(0, 0, -1, -1));
+}
+
+/*! \internal
+*/
+void QtEyedropper::mousePressEvent(QMouseEvent *e)
+{
+	stop();
+	if (e->button() == Qt::LeftButton && current.isValid()) {
+		track(e->globalPos());
+		emit picked(current);
+	} else {
+		emit cancelled();
+	}
+}
+
+/*! \internal
+*/
+void QtEyedropper::keyPressEvent(QKeyEvent *e)
+{
+	switch (e->key()) {
+	case Qt::Key_Return:
+	case Qt::Key_Enter:
+	case Qt::Key_Space:
+		stop();
+		if (current.isValid())
+			emit picked(current);
+		break;
+	case Qt::Key_Escape:
+		stop();
+		emit cancelled();
+		break;
+	default:
+		QWidget::keyPressEvent(e);
+		break;
+	}
+}
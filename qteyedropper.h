@@ -0,0 +1,96 @@
+#ifndef QTEYEDROPPER_H
+#define QTEYEDROPPER_H
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtWidgets/QWidget>
+
+#define QtPublicCtrlDLL
+
+class QTimer;
+
+/*
+    Where the eyedropper reads its pixels from. grab() returns the
+    pixels of a small region, in global coordinates; on high DPI
+    screens the image may hold more pixels than the region has points,
+    but its center is always the pixel under the center of the region.
+*/
+class QtPublicCtrlDLL QtPixelSource
+{
+public:
+    virtual ~QtPixelSource() {}
+    virtual QImage grab(const QRect &region) = 0;
+};
+
+/*
+    Reads the screens, grabbing only the requested region of the
+    screen it lies on.
+*/
+class QtPublicCtrlDLL QtScreenPixelSource : public QtPixelSource
+{
+public:
+    QImage grab(const QRect &region);
+};
+
+/*
+    Reads a fixed image placed at \a origin in global coordinates, for
+    tests and for the offscreen platform, where there is no screen to
+    read from.
+*/
+class QtPublicCtrlDLL QtImagePixelSource : public QtPixelSource
+{
+public:
+    QtImagePixelSource(const QImage &image, const QPoint &origin = QPoint());
+    QImage grab(const QRect &region);
+
+private:
+    QImage source;
+    QPoint offset;
+};
+
+/*
+    A magnifier that follows the cursor and picks the color under it.
+    The region around the cursor is read once per display frame, and
+    only when the cursor moved; clicking picks, Escape cancels.
+*/
+class QtPublicCtrlDLL QtEyedropper : public QWidget
+{
+    Q_OBJECT
+
+public:
+    QtEyedropper(QWidget *parent = 0);
+    ~QtEyedropper();
+
+    void setPixelSource(QtPixelSource *source);
+    QtPixelSource *pixelSource() const;
+
+    QColor color() const;
+    bool isActive() const;
+
+public Q_SLOTS:
+    void start();
+    void stop();
+    void track(const QPoint &globalPos);
+
+Q_SIGNALS:
+    void hovered(const QColor &);
+    void picked(const QColor &);
+    void cancelled();
+
+protected:
+    void paintEvent(QPaintEvent *e);
+    void mousePressEvent(QMouseEvent *e);
+    void keyPressEvent(QKeyEvent *e);
+
+private Q_SLOTS:
+    void poll();
+
+private:
+    QtScreenPixelSource screenSource;
+    QtPixelSource *source;
+    QTimer *pollTimer;
+    QImage sample;
+    QPoint lastPos;
+    QColor current;
+};
+
+#endif
@@ -0,0 +1,490 @@
+#include <QtGui/QPainter>
+#include <QtCore/QVarLengthArray>
+#include <QtCore/qmath.h>
+
+#include "qtcolorpicker.h"
+#include "qtcolorspace.h"
+#include "qtgradienteditor.h"
+#include "qtswatchcache.h"
+
+enum { PreviewHeight = 16, PickerSize = 22, PickerSpacing = 4, DefaultTableSize = 256 };
+
+/*! \internal
+
+Returns \a color as four floats in the interpolation \a space, alpha
+last. Hue is in degrees.
+*/
+static void toSpace(const QColor &color, int space, float *out)
+{
+	const QRgb rgb = color.rgba();
+	switch (space) {
+	case QtGradientEditor::LinearRgb:
+		out[0] = QtColorSpace::toLinear(qRed(rgb));
+		out[1] = QtColorSpace::toLinear(qGreen(rgb));
+		out[2] = QtColorSpace::toLinear(qBlue(rgb));
+		break;
+	case QtGradientEditor::Oklab: {
+		const QtLabColor lab = QtColorSpace::toOklab(rgb);
+		out[0] = lab.l;
+		out[1] = lab.a;
+		out[2] = lab.b;
+		break;
+	}
+	case QtGradientEditor::Hsv: {
+		qreal h, s, v, a;
+		color.getHsvF(&h, &s, &v, &a);
+		out[0] = h < 0 ? -1.0f : float(h * 360.0);
+		out[1] = float(s);
+		out[2] = float(v);
+		break;
+	}
+	default:
+		out[0] = qRed(rgb) / 255.0f;
+		out[1] = qGreen(rgb) / 255.0f;
+		out[2] = qBlue(rgb) / 255.0f;
+		break;
+	}
+	out[3] = qAlpha(rgb) / 255.0f;
+}
+
+/*! \internal
+
+Fills \a count table entries with the colors between \a c0 and \a c1,
+at parameters u0, u0 + du, ... The channels are interpolated in
+separate arrays, in loops the compiler vectorizes, and only then
+converted back to ARGB.
+*/
+static void interpolateSegment(QRgb *out, int count, float u0, float du,
+							   const float *c0, const float *c1, int space)
+{
+	QVarLengthArray<float, 1024> channels(count * 4);
+	float *ch[4] = { channels.data(), channels.data() + count, channels.data() + 2 * count, channels.data() + 3 * count };
+
+	for (int k = 0; k < 4; ++k) {
+		const float start = c0[k];
+		const float delta = c1[k] - c0[k];
+		float *values = ch[k];
+		for (int j = 0; j < count; ++j)
+			values[j] = start + delta * (u0 + du * j);
+	}
+
+	for (int j = 0; j < count; ++j) {
+		const int alpha = int(qBound(0.0f, ch[3][j], 1.0f) * 255.0f + 0.5f);
+		switch (space) {
+		case QtGradientEditor::LinearRgb:
+			out[j] = qRgba(QtColorSpace::fromLinear(ch[0][j]), QtColorSpace::fromLinear(ch[1][j]),
+				QtColorSpace::fromLinear(ch[2][j]), alpha);
+			break;
+		case QtGradientEditor::Oklab: {
+			QtLabColor lab;
+			lab.l = ch[0][j];
+			lab.a = ch[1][j];
+			lab.b = ch[2][j];
+			out[j] = QtColorSpace::fromOklab(lab, alpha);
+			break;
+		}
+		case QtGradientEditor::Hsv:
+			out[j] = QtColorSpace::fromHsv(ch[0][j], qBound(0.0f, ch[1][j], 1.0f), qBound(0.0f, ch[2][j], 1.0f), alpha);
+			break;
+		default:
+			out[j] = qRgba(int(qBound(0.0f, ch[0][j], 1.0f) * 255.0f + 0.5f),
+				int(qBound(0.0f, ch[1][j], 1.0f) * 255.0f + 0.5f),
+				int(qBound(0.0f, ch[2][j], 1.0f) * 255.0f + 0.5f), alpha);
+			break;
+		}
+	}
+}
+
+/*! \class QtGradientEditor
+
+\brief The QtGradientEditor class edits a multi-stop color gradient
+with one QtColorPicker per stop.
+
+The gradient is sampled through lookupTable(), a table of
+lookupTableSize() colors from position 0 to position 1, interpolated
+in the space set with setInterpolation(). The table is cached:
+changing a stop only recomputes the entries between the neighbouring
+stops, the next time the table is requested.
+*/
+
+/*!
+Constructs an empty gradient editor.
+*/
+QtGradientEditor::QtGradientEditor(QWidget *parent)
+	: QWidget(parent), space(Oklab), tableSize(DefaultTableSize),
+	dirtyFrom(0), dirtyTo(DefaultTableSize - 1)
+{
+	setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+}
+
+/*!
+Destructs the gradient editor.
+*/
+QtGradientEditor::~QtGradientEditor()
+{
+}
+
+/*!
+Returns the number of stops.
+*/
+int QtGradientEditor::stopCount() const
+{
+	return stopList.size();
+}
+
+/*!
+Adds a stop of the given \a color at \a position, clamped to [0, 1],
+and returns its index. Stops are kept sorted by position.
+*/
+int QtGradientEditor::insertStop(qreal position, const QColor &color)
+{
+	Stop stop;
+	stop.position = qBound(qreal(0), position, qreal(1));
+	stop.color = color;
+	stop.picker = new QtColorPicker(this);
+	stop.picker->setStandardColors();
+	stop.picker->setCurrentColor(color);
+	stop.picker->setFixedSize(PickerSize, PickerSize);
+	stop.picker->show();
+	connect(stop.picker, SIGNAL(colorChanged(const QColor &)), SLOT(pickerColorChanged(const QColor &)));
+
+	int index = 0;
+	while (index < stopList.size() && stopList.at(index).position <= stop.position)
+		++index;
+	stopList.insert(index, stop);
+
+	invalidateAround(index);
+	layoutPickers();
+	update();
+	emit stopsChanged();
+	return index;
+}
+
+/*!
+Removes the stop at \a index.
+*/
+void QtGradientEditor::removeStop(int index)
+{
+	if (index < 0 || index >= stopList.size())
+		return;
+
+	invalidate(index > 0 ? stopList.at(index - 1).position : 0,
+		index < stopList.size() - 1 ? stopList.at(index + 1).position : 1);
+	delete stopList.takeAt(index).picker;
+
+	update();
+	emit stopsChanged();
+}
+
+/*!
+Returns the position of the stop at \a index.
+*/
+qreal QtGradientEditor::stopPosition(int index) const
+{
+	return stopList.at(index).position;
+}
+
+/*!
+Moves the stop at \a index to \a position. The stop may change index
+if it passes one of its neighbours.
+*/
+void QtGradientEditor::setStopPosition(int index, qreal position)
+{
+	if (index < 0 || index >= stopList.size())
+		return;
+
+	invalidateAround(index);
+	stopList[index].position = qBound(qreal(0), position, qreal(1));
+	invalidateAround(sortStop(index));
+
+	layoutPickers();
+	update();
+	emit stopsChanged();
+}
+
+/*!
+Returns the color of the stop at \a index.
+*/
+QColor QtGradientEditor::stopColor(int index) const
+{
+	return stopList.at(index).color;
+}
+
+/*!
+Sets the color of the stop at \a index to \a color.
+*/
+void QtGradientEditor::setStopColor(int index, const QColor &color)
+{
+	if (index < 0 || index >= stopList.size() || stopList.at(index).color == color)
+		return;
+
+	stopList[index].color = color;
+	stopList.at(index).picker->blockSignals(true);
+	stopList.at(index).picker->setCurrentColor(color);
+	stopList.at(index).picker->blockSignals(false);
+
+	invalidateAround(index);
+	update();
+	emit stopsChanged();
+}
+
+/*!
+Returns the picker that edits the stop at \a index.
+*/
+QtColorPicker *QtGradientEditor::stopPicker(int index) const
+{
+	return stopList.at(index).picker;
+}
+
+/*!
+Returns the stops as a QGradientStops, usable with QGradient.
+*/
+QGradientStops QtGradientEditor::stops() const
+{
+	QGradientStops result;
+	for (int i = 0; i < stopList.size(); ++i)
+		result.append(QGradientStop(stopList.at(i).position, stopList.at(i).color));
+	return result;
+}
+
+/*!
+Replaces all the stops with \a stops.
+*/
+void QtGradientEditor::setStops(const QGradientStops &stops)
+{
+	const bool blocked = blockSignals(true);
+	while (!stopList.isEmpty())
+		removeStop(stopList.size() - 1);
+	for (int i = 0; i < stops.size(); ++i)
+		insertStop(stops.at(i).first, stops.at(i).second);
+	blockSignals(blocked);
+
+	invalidate(0, 1);
+	emit stopsChanged();
+}
+
+/*!
+Sets the color space the stops are interpolated in. Oklab, the
+default, gives perceptually even ramps; Srgb matches QGradient.
+*/
+void QtGradientEditor::setInterpolation(Interpolation interpolation)
+{
+	if (space == interpolation)
+		return;
+
+	space = interpolation;
+	invalidate(0, 1);
+	update();
+}
+
+QtGradientEditor::Interpolation QtGradientEditor::interpolation() const
+{
+	return space;
+}
+
+/*!
+Sets the number of entries of lookupTable() to \a size, at least 2.
+*/
+void QtGradientEditor::setLookupTableSize(int size)
+{
+	size = qMax(2, size);
+	if (tableSize == size)
+		return;
+
+	tableSize = size;
+	invalidate(0, 1);
+	update();
+}
+
+int QtGradientEditor::lookupTableSize() const
+{
+	return tableSize;
+}
+
+/*!
+Returns the gradient sampled at lookupTableSize() evenly spaced
+positions, from 0 to 1. Entries before the first stop and after the
+last one repeat their color; an editor without stops is transparent.
+
+The table is implicitly shared: copies are cheap, and stay valid
+while the editor changes.
+*/
+QVector<QRgb> QtGradientEditor::lookupTable() const
+{
+	updateTable();
+	return table;
+}
+
+/*!
+Returns the table entry nearest to \a position.
+*/
+QRgb QtGradientEditor::sample(qreal position) const
+{
+	updateTable();
+	return table.at(qRound(qBound(qreal(0), position, qreal(1)) * (tableSize - 1)));
+}
+
+/*! \internal
+
+Marks the table entries from \a from to \a to as out of date.
+*/
+void QtGradientEditor::invalidate(qreal from, qreal to)
+{
+	dirtyFrom = qMin(dirtyFrom, qMax(0, int(floor(from * (tableSize - 1)))));
+	dirtyTo = qMax(dirtyTo, qMin(tableSize - 1, int(ceil(to * (tableSize - 1)))));
+}
+
+/*! \internal
+
+Marks the entries a change of the stop at \a index affects: those
+between its two neighbours, or up to the end of the table for the
+first and last stops.
+*/
+void QtGradientEditor::invalidateAround(int index)
+{
+	invalidate(index > 0 ? stopList.at(index - 1).position : 0,
+		index < stopList.size() - 1 ? stopList.at(index + 1).position : 1);
+}
+
+/*! \internal
+
+Recomputes the out of date entries, segment by segment.
+*/
+void QtGradientEditor::updateTable() const
+{
+	if (table.size() != tableSize) {
+		table.resize(tableSize);
+		dirtyFrom = 0;
+		dirtyTo = tableSize - 1;
+	}
+	if (dirtyFrom > dirtyTo)
+		return;
+
+	QRgb *data = table.data();
+	const int last = tableSize - 1;
+
+	if (stopList.isEmpty()) {
+		for (int i = dirtyFrom; i <= dirtyTo; ++i)
+			data[i] = 0;
+	} else {
+		// Up to the first stop and after the last one. The head is
+		// inclusive so that a single stop on an entry still fills it;
+		// a following segment writes the same color there.
+		const int head = qMin(dirtyTo, int(floor(stopList.first().position * last)));
+		for (int i = dirtyFrom; i <= head; ++i)
+			data[i] = stopList.first().color.rgba();
+		const int tail = qMax(dirtyFrom, int(floor(stopList.last().position * last)) + 1);
+		for (int i = tail; i <= dirtyTo; ++i)
+			data[i] = stopList.last().color.rgba();
+
+		for (int k = 0; k + 1 < stopList.size(); ++k) {
+			const qreal p0 = stopList.at(k).position;
+			const qreal p1 = stopList.at(k + 1).position;
+			const int lo = qMax(dirtyFrom, int(ceil(p0 * last)));
+			const int hi = qMin(dirtyTo, int(floor(p1 * last)));
+			if (lo > hi)
+				continue;
+
+			float c0[4], c1[4];
+			toSpace(stopList.at(k).color, space, c0);
+			toSpace(stopList.at(k + 1).color, space, c1);
+			if (space == Hsv) {
+				// An achromatic end takes the hue of the other one, and
+				// hue goes the short way around the circle.
+				if (c0[0] < 0)
+					c0[0] = c1[0] < 0 ? 0 : c1[0];
+				if (c1[0] < 0)
+					c1[0] = c0[0];
+				if (c1[0] - c0[0] > 180)
+					c1[0] -= 360;
+				else if (c0[0] - c1[0] > 180)
+					c1[0] += 360;
+			}
+
+			const float span = float(p1 - p0);
+			const float du = span > 0 ? 1.0f / (span * last) : 0.0f;
+			const float u0 = span > 0 ? float((lo / qreal(last) - p0) / span) : 0.0f;
+			interpolateSegment(data + lo, hi - lo + 1, u0, du, c0, c1, space);
+		}
+	}
+
+	dirtyFrom = tableSize;
+	dirtyTo = -1;
+}
+
+/*! \internal
+
+Moves the stop at \a index to keep the stops sorted, and returns its
+new index.
+*/
+int QtGradientEditor::sortStop(int index)
+{
+	const Stop stop = stopList.takeAt(index);
+	int i = 0;
+	while (i < stopList.size() && stopList.at(i).position <= stop.position)
+		++i;
+	stopList.insert(i, stop);
+	return i;
+}
+
+/*! \internal
+
+Places each picker under its stop.
+*/
+void QtGradientEditor::layoutPickers()
+{
+	const int span = width() - PickerSize;
+	for (int i = 0; i < stopList.size(); ++i) {
+		const int x = qRound(stopList.at(i).position * span);
+		stopList.at(i).picker->move(x, PreviewHeight + PickerSpacing);
+	}
+}
+
+/*! \internal
+
+*/
+void QtGradientEditor::pickerColorChanged(const QColor &color)
+{
+	for (int i = 0; i < stopList.size(); ++i) {
+		if (stopList.at(i).picker == sender()) {
+			stopList[i].color = color;
+			invalidateAround(i);
+			update();
+			emit stopsChanged();
+			return;
+		}
+	}
+}
+
+/*! \internal
+*/
+QSize QtGradientEditor::sizeHint() const
+{
+	return QSize(240, PreviewHeight + PickerSpacing + PickerSize);
+}
+
+/*! \internal
+
+Draws the lookup table itself, over a checkerboard, so the preview
+shows exactly what consumers sample.
+*/
+void QtGradientEditor::paintEvent(QPaintEvent *)
+{
+	const QVector<QRgb> lut = lookupTable();
+	const QImage strip(reinterpret_cast<const uchar *>(lut.constData()), lut.size(), 1, QImage::Format_ARGB32);
+
+	QPainter p(this);
+	const QRect preview(PickerSize / 2, 0, width() - PickerSize, PreviewHeight);
+	p.drawTiledPixmap(preview, QtSwatchCache::checkerboard(devicePixelRatioF()));
+	p.drawImage(preview, strip);
+	p.setPen(QColor("#5c5c5c"));
+	p.drawRect(preview.adjusted(0, 0, -1, -1));
+}
+
+/*! \internal
+*/
+void QtGradientEditor::resizeEvent(QResizeEvent *e)
+{
+	QWidget::resizeEvent(e);
+	layoutPickers();
+}
@@ -0,0 +1,87 @@
+#ifndef QTGRADIENTEDITOR_H
+#define QTGRADIENTEDITOR_H
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QtGui/QGradient>
+#include <QtWidgets/QWidget>
+
+#define QtPublicCtrlDLL
+
+class QtColorPicker;
+
+/*
+    A multi-stop gradient editor. Each stop is edited with its own
+    QtColorPicker, placed under a preview of the gradient.
+
+    The gradient is exposed as a lookup table of lookupTableSize()
+    entries, interpolated in the chosen space. When a stop changes,
+    only the table entries between its neighbours are recomputed.
+*/
+class QtPublicCtrlDLL QtGradientEditor : public QWidget
+{
+    Q_OBJECT
+
+public:
+    enum Interpolation { Srgb, LinearRgb, Oklab, Hsv };
+
+    QtGradientEditor(QWidget *parent = 0);
+    ~QtGradientEditor();
+
+    int stopCount() const;
+    int insertStop(qreal position, const QColor &color);
+    void removeStop(int index);
+
+    qreal stopPosition(int index) const;
+    void setStopPosition(int index, qreal position);
+    QColor stopColor(int index) const;
+    void setStopColor(int index, const QColor &color);
+    QtColorPicker *stopPicker(int index) const;
+
+    QGradientStops stops() const;
+    void setStops(const QGradientStops &stops);
+
+    void setInterpolation(Interpolation interpolation);
+    Interpolation interpolation() const;
+
+    void setLookupTableSize(int size);
+    int lookupTableSize() const;
+
+    QVector<QRgb> lookupTable() const;
+    QRgb sample(qreal position) const;
+
+    QSize sizeHint() const;
+
+Q_SIGNALS:
+    void stopsChanged();
+
+protected:
+    void paintEvent(QPaintEvent *e);
+    void resizeEvent(QResizeEvent *e);
+
+private Q_SLOTS:
+    void pickerColorChanged(const QColor &color);
+
+private:
+    struct Stop
+    {
+        qreal position;
+        QColor color;
+        QtColorPicker *picker;
+    };
+
+    void invalidate(qreal from, qreal to);
+    void invalidateAround(int index);
+    void updateTable() const;
+    void layoutPickers();
+    int sortStop(int index);
+
+    QList<Stop> stopList;
+    Interpolation space;
+    int tableSize;
+    mutable QVector<QRgb> table;
+    mutable int dirtyFrom;
+    mutable int dirtyTo;
+};
+
+#endif
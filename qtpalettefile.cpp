@@ -0,0 +1,217 @@
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QTimer>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "qtcolorparser.h"
+#include "qtpalettefile.h"
+
+// Editors often save in several steps; changes closer than this are
+// read once.
+enum { ReloadDelay = 50 };
+
+/*! \internal
+
+Reads the "R G B name" entries of a GIMP palette, skipping the
+header fields and the comments.
+*/
+static void readGimpLine(const QString &line, QList<QColor> *colors, QStringList *names)
+{
+	if (line.startsWith(QLatin1Char('#')) || line.startsWith(QLatin1String("Name:"))
+		|| line.startsWith(QLatin1String("Columns:")))
+		return;
+
+	const QChar *p = line.constData();
+	const QChar *end = p + line.size();
+	int rgb[3];
+	for (int i = 0; i < 3; ++i) {
+		while (p < end && p->isSpace())
+			++p;
+		if (p == end || !p->isDigit())
+			return;
+		rgb[i] = 0;
+		while (p < end && p->isDigit())
+			rgb[i] = rgb[i] * 10 + p++->digitValue();
+	}
+
+	colors->append(QColor(qBound(0, rgb[0], 255), qBound(0, rgb[1], 255), qBound(0, rgb[2], 255)));
+	names->append(QString(p, int(end - p)).trimmed());
+}
+
+/*! \internal
+
+Reads a "color name" entry: the color runs up to the first space
+outside parentheses, so that "rgb(1, 2, 3) Name" is understood.
+*/
+static void readTextLine(const QString &line, QList<QColor> *colors, QStringList *names)
+{
+	const QChar *begin = line.constData();
+	const QChar *end = begin + line.size();
+	const QChar *p = begin;
+	int depth = 0;
+	for (; p < end; ++p) {
+		if (*p == QLatin1Char('('))
+			++depth;
+		else if (*p == QLatin1Char(')') && depth > 0)
+			--depth;
+		else if (!depth && p->isSpace())
+			break;
+	}
+
+	QRgb rgba;
+	if (!QtColorParser::parse(begin, int(p - begin), &rgba))
+		return;
+
+	colors->append(QColor::fromRgba(rgba));
+	names->append(QString(p, int(end - p)).trimmed());
+}
+
+/*!
+Constructs a palette file with no file name.
+*/
+QtPaletteFile::QtPaletteFile(QObject *parent)
+	: QObject(parent), reloadPending(false)
+{
+	watcher = new QFileSystemWatcher(this);
+	connect(watcher, SIGNAL(fileChanged(const QString &)), SLOT(fileChanged()));
+
+	future = new QFutureWatcher<Contents>(this);
+	connect(future, SIGNAL(finished()), SLOT(parsed()));
+
+	reloadTimer = new QTimer(this);
+	reloadTimer->setSingleShot(true);
+	reloadTimer->setInterval(ReloadDelay);
+	connect(reloadTimer, SIGNAL(timeout()), SLOT(reload()));
+}
+
+/*!
+Destructs the palette file, waiting for a pending parse to finish.
+*/
+QtPaletteFile::~QtPaletteFile()
+{
+	future->waitForFinished();
+}
+
+/*!
+Watches \a fileName and starts reading it. loaded() is emitted when
+the entries are ready, and again each time the file is saved.
+*/
+void QtPaletteFile::setFileName(const QString &fileName)
+{
+	if (file == fileName)
+		return;
+
+	if (!watcher->files().isEmpty())
+		watcher->removePaths(watcher->files());
+	file = fileName;
+	if (!file.isEmpty()) {
+		watcher->addPath(file);
+		reload();
+	}
+}
+
+QString QtPaletteFile::fileName() const
+{
+	return file;
+}
+
+/*!
+Returns the colors of the last successful read, in file order.
+*/
+QList<QColor> QtPaletteFile::colors() const
+{
+	return entryColors;
+}
+
+/*!
+Returns the names of the entries, matching colors().
+*/
+QStringList QtPaletteFile::names() const
+{
+	return entryNames;
+}
+
+/*!
+Reads the entries of \a fileName into \a colors and \a names, on the
+calling thread. Returns false if the file cannot be opened.
+*/
+bool QtPaletteFile::read(const QString &fileName, QList<QColor> *colors, QStringList *names)
+{
+	const Contents contents = load(fileName);
+	*colors = contents.colors;
+	*names = contents.names;
+	return contents.ok;
+}
+
+/*! \internal
+
+Runs on the thread pool.
+*/
+QtPaletteFile::Contents QtPaletteFile::load(const QString &fileName)
+{
+	Contents contents;
+	QFile device(fileName);
+	contents.ok = device.open(QIODevice::ReadOnly | QIODevice::Text);
+	if (!contents.ok)
+		return contents;
+
+	const QStringList lines = QString::fromUtf8(device.readAll()).split(QLatin1Char('\n'));
+	const bool gimp = !lines.isEmpty() && lines.first().trimmed() == QLatin1String("GIMP Palette");
+	for (int i = gimp ? 1 : 0; i < lines.size(); ++i) {
+		const QString line = lines.at(i).trimmed();
+		if (line.isEmpty())
+			continue;
+		if (gimp)
+			readGimpLine(line, &contents.colors, &contents.names);
+		else
+			readTextLine(line, &contents.colors, &contents.names);
+	}
+	return contents;
+}
+
+/*! \internal
+
+Editors that save by replacing the file make the watcher drop it, so
+it is added back before reading.
+*/
+void QtPaletteFile::fileChanged()
+{
+	if (!watcher->files().contains(file) && QFileInfo(file).exists())
+		watcher->addPath(file);
+	reloadTimer->start();
+}
+
+/*! \internal
+
+Starts parsing the file on the thread pool. A change reported while
+a parse is running is read once that parse is done.
+*/
+void QtPaletteFile::reload()
+{
+	if (future->isRunning()) {
+		reloadPending = true;
+		return;
+	}
+	future->setFuture(QtConcurrent::run(&QtPaletteFile::load, file));
+}
+
+/*! \internal
+
+*/
+void QtPaletteFile::parsed()
+{
+	if (reloadPending) {
+		reloadPending = false;
+		reload();
+		return;
+	}
+
+	const Contents contents = future->result();
+	if (!contents.ok || (contents.colors == entryColors && contents.names == entryNames))
+		return;
+
+	entryColors = contents.colors;
+	entryNames = contents.names;
+	emit loaded();
+}
@@ -0,0 +1,67 @@
+#ifndef QTPALETTEFILE_H
+#define QTPALETTEFILE_H
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtGui/QColor>
+
+#define QtPublicCtrlDLL
+
+class QFileSystemWatcher;
+class QTimer;
+
+/*
+    A palette file kept in sync with the disk. The file is watched
+    with QFileSystemWatcher and parsed again on the thread pool each
+    time it is saved; loaded() is emitted on the GUI thread once the
+    new entries are ready.
+
+    GIMP palettes (.gpl) are read as such. Any other file is read as
+    one entry per line: a color in a form understood by QtColorParser,
+    optionally followed by its name.
+*/
+class QtPublicCtrlDLL QtPaletteFile : public QObject
+{
+    Q_OBJECT
+
+public:
+    QtPaletteFile(QObject *parent = 0);
+    ~QtPaletteFile();
+
+    void setFileName(const QString &fileName);
+    QString fileName() const;
+
+    QList<QColor> colors() const;
+    QStringList names() const;
+
+    static bool read(const QString &fileName, QList<QColor> *colors, QStringList *names);
+
+Q_SIGNALS:
+    void loaded();
+
+private Q_SLOTS:
+    void fileChanged();
+    void reload();
+    void parsed();
+
+private:
+    struct Contents
+    {
+        bool ok;
+        QList<QColor> colors;
+        QStringList names;
+    };
+
+    static Contents load(const QString &fileName);
+
+    QString file;
+    QList<QColor> entryColors;
+    QStringList entryNames;
+    QFileSystemWatcher *watcher;
+    QFutureWatcher<Contents> *future;
+    QTimer *reloadTimer;
+    bool reloadPending;
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include <QtCore/QPair>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+
+#include "qtpalettequantizer.h"
+
+enum { HistogramBits = 5, HistogramSize = 1 << (3 * HistogramBits), KMeansPasses = 3 };
+
+/*! \internal
+
+One bin of the 15 bit histogram. The channel sums keep the exact
+mean of the pixels that fell in the bin, so the 3 bits dropped by
+the binning do not bias the resulting colors.
+*/
+struct QtHistogramBin
+{
+	quint64 count;
+	quint64 r;
+	quint64 g;
+	quint64 b;
+};
+
+/*! \internal
+
+A horizontal band of the image, histogrammed by one worker.
+*/
+struct QtHistogramBand
+{
+	const QImage *image;
+	int firstLine;
+	int lastLine;
+	QVector<QtHistogramBin> bins;
+};
+
+/*! \internal
+
+A box of histogram bins, [begin, end) in the sorted bin index list.
+*/
+struct QtColorBox
+{
+	int begin;
+	int end;
+	quint64 population;
+	int axis;
+	int range;
+};
+
+static inline int histogramIndex(QRgb p)
+{
+	return ((p >> 9) & 0x7c00) | ((p >> 6) & 0x03e0) | ((p >> 3) & 0x001f);
+}
+
+static inline int histogramComponent(int index, int axis)
+{
+	return (index >> (HistogramBits * (2 - axis))) & ((1 << HistogramBits) - 1);
+}
+
+/*! \internal
+
+Histograms the lines of \a band. Bin indices are computed for a
+whole line first, in a branch-free loop the compiler vectorizes,
+and only then scattered into the bins.
+*/
+static void histogramBand(QtHistogramBand &band)
+{
+	const int width = band.image->width();
+	QVector<int> index(width);
+	int *indexData = index.data();
+	QtHistogramBin *bins = band.bins.data();
+
+	for (int y = band.firstLine; y < band.lastLine; ++y) {
+		const QRgb *line = reinterpret_cast<const QRgb *>(band.image->constScanLine(y));
+		for (int x = 0; x < width; ++x)
+			indexData[x] = histogramIndex(line[x]);
+
+		for (int x = 0; x < width; ++x) {
+			const QRgb p = line[x];
+			if (qAlpha(p) == 0)
+				continue;
+			QtHistogramBin &bin = bins[indexData[x]];
+			++bin.count;
+			bin.r += qRed(p);
+			bin.g += qGreen(p);
+			bin.b += qBlue(p);
+		}
+	}
+}
+
+/*! \internal
+
+Computes the population and the longest axis of \a box.
+*/
+static void shrinkBox(QtColorBox &box, const QVector<int> &order, const QVector<QtHistogramBin> &histogram)
+{
+	int low[3] = { 255, 255, 255 };
+	int high[3] = { 0, 0, 0 };
+	box.population = 0;
+
+	for (int i = box.begin; i < box.end; ++i) {
+		const int index = order.at(i);
+		box.population += histogram.at(index).count;
+		for (int axis = 0; axis < 3; ++axis) {
+			const int c = histogramComponent(index, axis);
+			low[axis] = qMin(low[axis], c);
+			high[axis] = qMax(high[axis], c);
+		}
+	}
+
+	box.axis = 0;
+	box.range = high[0] - low[0];
+	for (int axis = 1; axis < 3; ++axis) {
+		if (high[axis] - low[axis] > box.range) {
+			box.axis = axis;
+			box.range = high[axis] - low[axis];
+		}
+	}
+}
+
+/*! \internal
+
+Orders bin indices along one histogram axis.
+*/
+struct QtAxisLess
+{
+	int axis;
+	bool operator()(int i1, int i2) const
+	{
+		return histogramComponent(i1, axis) < histogramComponent(i2, axis);
+	}
+};
+
+/*!
+Returns at most \a maxColors colors representative of \a image, most
+frequent first. Fully transparent pixels are ignored.
+
+The histogram pass runs on all cores through QtConcurrent; the
+reduction only looks at the (at most 32768) non-empty histogram bins,
+so its cost does not depend on the image size.
+
+\sa quantizeAsync()
+*/
+QList<QColor> QtPaletteQuantizer::quantize(const QImage &image, int maxColors)
+{
+	QList<QColor> palette;
+	if (image.isNull() || maxColors <= 0)
+		return palette;
+
+	QImage source = image;
+	if (source.format() != QImage::Format_RGB32 && source.format() != QImage::Format_ARGB32)
+		source = source.convertToFormat(QImage::Format_ARGB32);
+
+	// Histogram the image in one band per core.
+	const int bandCount = qBound(1, QThread::idealThreadCount(), source.height());
+	QVector<QtHistogramBand> bands(bandCount);
+	for (int i = 0; i < bandCount; ++i) {
+		bands[i].image = &source;
+		bands[i].firstLine = source.height() * i / bandCount;
+		bands[i].lastLine = source.height() * (i + 1) / bandCount;
+		bands[i].bins.resize(HistogramSize);
+	}
+	QtConcurrent::blockingMap(bands, histogramBand);
+
+	QVector<QtHistogramBin> histogram = bands.at(0).bins;
+	for (int i = 1; i < bandCount; ++i) {
+		const QtHistogramBin *bins = bands.at(i).bins.constData();
+		for (int j = 0; j < HistogramSize; ++j) {
+			histogram[j].count += bins[j].count;
+			histogram[j].r += bins[j].r;
+			histogram[j].g += bins[j].g;
+			histogram[j].b += bins[j].b;
+		}
+	}
+	bands.clear();
+
+	QVector<int> order;
+	for (int i = 0; i < HistogramSize; ++i) {
+		if (histogram.at(i).count)
+			order.append(i);
+	}
+	if (order.isEmpty())
+		return palette;
+
+	// Median cut: keep splitting the box with the most pixels spread
+	// along its longest axis, at the population median of that axis.
+	QVector<QtColorBox> boxes;
+	QtColorBox first;
+	first.begin = 0;
+	first.end = order.size();
+	shrinkBox(first, order, histogram);
+	boxes.append(first);
+
+	while (boxes.size() < maxColors) {
+		int split = -1;
+		quint64 splitScore = 0;
+		for (int i = 0; i < boxes.size(); ++i) {
+			const quint64 score = boxes.at(i).population * quint64(boxes.at(i).range);
+			if (boxes.at(i).end - boxes.at(i).begin > 1 && score > splitScore) {
+				split = i;
+				splitScore = score;
+			}
+		}
+		if (split == -1)
+			break;
+
+		QtColorBox &box = boxes[split];
+		QtAxisLess less;
+		less.axis = box.axis;
+		std::sort(order.begin() + box.begin, order.begin() + box.end, less);
+
+		quint64 half = 0;
+		int median = box.begin;
+		while (median < box.end - 1 && half * 2 < box.population)
+			half += histogram.at(order.at(median++)).count;
+		median = qBound(box.begin + 1, median, box.end - 1);
+
+		QtColorBox upper;
+		upper.begin = median;
+		upper.end = box.end;
+		box.end = median;
+		shrinkBox(box, order, histogram);
+		shrinkBox(upper, order, histogram);
+		boxes.append(upper);
+	}
+
+	// Refine the box means with a few k-means passes over the bins.
+	const int k = boxes.size();
+	QVector<double> centers(k * 3);
+	for (int i = 0; i < k; ++i) {
+		double r = 0, g = 0, b = 0;
+		for (int j = boxes.at(i).begin; j < boxes.at(i).end; ++j) {
+			const QtHistogramBin &bin = histogram.at(order.at(j));
+			r += bin.r;
+			g += bin.g;
+			b += bin.b;
+		}
+		centers[i * 3] = r / boxes.at(i).population;
+		centers[i * 3 + 1] = g / boxes.at(i).population;
+		centers[i * 3 + 2] = b / boxes.at(i).population;
+	}
+
+	QVector<double> sums(k * 3);
+	QVector<quint64> populations(k);
+	for (int pass = 0; pass < KMeansPasses; ++pass) {
+		sums.fill(0);
+		populations.fill(0);
+		for (int j = 0; j < order.size(); ++j) {
+			const QtHistogramBin &bin = histogram.at(order.at(j));
+			const double r = double(bin.r) / bin.count;
+			const double g = double(bin.g) / bin.count;
+			const double b = double(bin.b) / bin.count;
+
+			int nearest = 0;
+			double nearestDistance = 1e30;
+			for (int i = 0; i < k; ++i) {
+				const double dr = r - centers.at(i * 3);
+				const double dg = g - centers.at(i * 3 + 1);
+				const double db = b - centers.at(i * 3 + 2);
+				const double distance = dr * dr + dg * dg + db * db;
+				if (distance < nearestDistance) {
+					nearest = i;
+					nearestDistance = distance;
+				}
+			}
+
+			sums[nearest * 3] += bin.r;
+			sums[nearest * 3 + 1] += bin.g;
+			sums[nearest * 3 + 2] += bin.b;
+			populations[nearest] += bin.count;
+		}
+
+		for (int i = 0; i < k; ++i) {
+			if (!populations.at(i))
+				continue;
+			centers[i * 3] = sums.at(i * 3) / populations.at(i);
+			centers[i * 3 + 1] = sums.at(i * 3 + 1) / populations.at(i);
+			centers[i * 3 + 2] = sums.at(i * 3 + 2) / populations.at(i);
+		}
+	}
+
+	QVector<QPair<quint64, int> > ranking;
+	for (int i = 0; i < k; ++i) {
+		if (populations.at(i))
+			ranking.append(qMakePair(populations.at(i), i));
+	}
+	std::sort(ranking.begin(), ranking.end());
+
+	for (int i = ranking.size() - 1; i >= 0; --i) {
+		const int c = ranking.at(i).second;
+		palette.append(QColor(qRound(centers.at(c * 3)),
+			qRound(centers.at(c * 3 + 1)),
+			qRound(centers.at(c * 3 + 2))));
+	}
+	return palette;
+}
+
+/*!
+Runs quantize() on the global thread pool, so that the GUI thread
+can keep processing events while a large image is analysed.
+*/
+QFuture<QList<QColor> > QtPaletteQuantizer::quantizeAsync(const QImage &image, int maxColors)
+{
+	return QtConcurrent::run(&QtPaletteQuantizer::quantize, image, maxColors);
+}
@@ -0,0 +1,24 @@
+#ifndef QTPALETTEQUANTIZER_H
+#define QTPALETTEQUANTIZER_H
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+
+#define QtPublicCtrlDLL
+
+/*
+    Derives a small palette from an image: a 15 bit histogram is built
+    in parallel over horizontal bands of the image, then reduced with
+    median cut and refined with a few k-means passes over the
+    histogram bins. Colors are returned most frequent first, ready for
+    QtColorPicker::insertColors().
+*/
+class QtPublicCtrlDLL QtPaletteQuantizer
+{
+public:
+    static QList<QColor> quantize(const QImage &image, int maxColors = 16);
+    static QFuture<QList<QColor> > quantizeAsync(const QImage &image, int maxColors = 16);
+};
+
+#endif
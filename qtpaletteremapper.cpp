@@ -0,0 +1,300 @@
+#include <QtCore/QThread>
+#include <QtConcurrent/QtConcurrentMap>
+#include <float.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QTPALETTEREMAPPER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "qtcolorspace.h"
+#include "qtpaletteremapper.h"
+
+enum { LutBits = 6, LutSide = 1 << LutBits, LutSize = LutSide * LutSide * LutSide, TileSize = 64 * 1024 };
+
+static inline int lutIndex(QRgb p)
+{
+	return ((p >> 6) & 0x3f000) | ((p >> 4) & 0x0fc0) | ((p >> 2) & 0x003f);
+}
+
+/*! \internal
+
+Returns the index of the entry closest to (\a l, \a a, \a b) among the
+\a count entries stored as separate coordinate arrays. \a count is a
+multiple of 4; the SSE2 kernel compares four entries per step.
+*/
+static int nearestEntry(float l, float a, float b,
+						const float *pl, const float *pa, const float *pb, int count)
+{
+#ifdef QTPALETTEREMAPPER_SSE2
+	const __m128 vl = _mm_set1_ps(l);
+	const __m128 va = _mm_set1_ps(a);
+	const __m128 vb = _mm_set1_ps(b);
+	const __m128i four = _mm_set1_epi32(4);
+	__m128 best = _mm_set1_ps(FLT_MAX);
+	__m128i bestIndex = _mm_setzero_si128();
+	__m128i index = _mm_set_epi32(3, 2, 1, 0);
+
+	for (int i = 0; i < count; i += 4) {
+		const __m128 dl = _mm_sub_ps(_mm_loadu_ps(pl + i), vl);
+		const __m128 da = _mm_sub_ps(_mm_loadu_ps(pa + i), va);
+		const __m128 db = _mm_sub_ps(_mm_loadu_ps(pb + i), vb);
+		const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dl, dl), _mm_mul_ps(da, da)), _mm_mul_ps(db, db));
+		const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+		best = _mm_min_ps(d, best);
+		bestIndex = _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, bestIndex));
+		index = _mm_add_epi32(index, four);
+	}
+
+	float distances[4];
+	int indices[4];
+	_mm_storeu_ps(distances, best);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(indices), bestIndex);
+
+	int nearest = indices[0];
+	float nearestDistance = distances[0];
+	for (int i = 1; i < 4; ++i) {
+		if (distances[i] < nearestDistance || (distances[i] == nearestDistance && indices[i] < nearest)) {
+			nearest = indices[i];
+			nearestDistance = distances[i];
+		}
+	}
+	return nearest;
+#else
+	int nearest = 0;
+	float nearestDistance = FLT_MAX;
+	for (int i = 0; i < count; ++i) {
+		const float dl = pl[i] - l;
+		const float da = pa[i] - a;
+		const float db = pb[i] - b;
+		const float d = dl * dl + da * da + db * db;
+		if (d < nearestDistance) {
+			nearest = i;
+			nearestDistance = d;
+		}
+	}
+	return nearest;
+#endif
+}
+
+/*! \internal
+
+Fills the lookup table entries of one red slice of the RGB grid.
+*/
+struct QtLutSlice
+{
+	typedef void result_type;
+
+	const float *pl;
+	const float *pa;
+	const float *pb;
+	int count;
+	quint16 *lut;
+
+	void operator()(int red) const
+	{
+		quint16 *cell = lut + red * LutSide * LutSide;
+		for (int green = 0; green < LutSide; ++green) {
+			for (int blue = 0; blue < LutSide; ++blue) {
+				// Sample the center of the cell.
+				const QtLabColor lab = QtColorSpace::toOklab(qRgb((red << 2) + 2, (green << 2) + 2, (blue << 2) + 2));
+				*cell++ = quint16(nearestEntry(lab.l, lab.a, lab.b, pl, pa, pb, count));
+			}
+		}
+	}
+};
+
+/*! \internal
+
+A run of consecutive pixels remapped by one worker.
+*/
+struct QtRemapTile
+{
+	const QRgb *source;
+	QRgb *destination;
+	int count;
+};
+
+/*! \internal
+
+Remaps one tile through the lookup table.
+*/
+struct QtRemapKernel
+{
+	typedef void result_type;
+
+	const QRgb *colors;
+	const quint16 *lut;
+
+	void operator()(const QtRemapTile &tile) const
+	{
+		const QRgb *source = tile.source;
+		QRgb *destination = tile.destination;
+		for (int i = 0; i < tile.count; ++i) {
+			const QRgb p = source[i];
+			destination[i] = (colors[lut[lutIndex(p)]] & 0x00ffffff) | (p & 0xff000000);
+		}
+	}
+};
+
+/*!
+Constructs a remapper with an empty palette.
+*/
+QtPaletteRemapper::QtPaletteRemapper()
+{
+}
+
+/*!
+Constructs a remapper for \a palette.
+*/
+QtPaletteRemapper::QtPaletteRemapper(const QList<QColor> &palette)
+{
+	setPalette(palette);
+}
+
+/*!
+Sets the palette colors are mapped to and rebuilds the lookup table,
+splitting the work across all cores. At most 65536 entries are used.
+*/
+void QtPaletteRemapper::setPalette(const QList<QColor> &palette)
+{
+	colors.clear();
+	lut.clear();
+	for (int i = 0; i < palette.size() && colors.size() <= 0xffff; ++i) {
+		if (palette.at(i).isValid())
+			colors.append(palette.at(i).rgba());
+	}
+	if (colors.isEmpty())
+		return;
+
+	// Store the palette as padded coordinate arrays for the kernel.
+	const int count = (colors.size() + 3) & ~3;
+	QVector<float> pl(count, 1e6f), pa(count, 1e6f), pb(count, 1e6f);
+	for (int i = 0; i < colors.size(); ++i) {
+		const QtLabColor lab = QtColorSpace::toOklab(colors.at(i));
+		pl[i] = lab.l;
+		pa[i] = lab.a;
+		pb[i] = lab.b;
+	}
+
+	lut.resize(LutSize);
+	QVector<int> slices(LutSide);
+	for (int i = 0; i < LutSide; ++i)
+		slices[i] = i;
+
+	QtLutSlice slice;
+	slice.pl = pl.constData();
+	slice.pa = pa.constData();
+	slice.pb = pb.constData();
+	slice.count = count;
+	slice.lut = lut.data();
+	QtConcurrent::blockingMap(slices, slice);
+}
+
+/*!
+Returns the palette colors are mapped to.
+*/
+QList<QColor> QtPaletteRemapper::palette() const
+{
+	QList<QColor> palette;
+	for (int i = 0; i < colors.size(); ++i)
+		palette.append(QColor::fromRgba(colors.at(i)));
+	return palette;
+}
+
+/*!
+Returns true if the palette is empty; remapping is then a plain copy.
+*/
+bool QtPaletteRemapper::isEmpty() const
+{
+	return colors.isEmpty();
+}
+
+/*!
+Returns the index in palette() of the entry nearest to \a rgb, or -1
+if the palette is empty.
+
+The result is looked up in a table of 64 x 64 x 64 cells and is the
+entry nearest to the center of the cell holding \a rgb. Entries less
+than a cell apart may share a cell, so even a palette color is not
+guaranteed to map to itself. Use QtColorPalette::nearest() for an
+exact match.
+*/
+int QtPaletteRemapper::nearestIndex(QRgb rgb) const
+{
+	return colors.isEmpty() ? -1 : lut.at(lutIndex(rgb));
+}
+
+/*!
+Returns the palette entry nearest to \a rgb, with the alpha of \a rgb.
+Like nearestIndex(), the match is only accurate to a table cell.
+*/
+QRgb QtPaletteRemapper::nearest(QRgb rgb) const
+{
+	if (colors.isEmpty())
+		return rgb;
+	return (colors.at(lut.at(lutIndex(rgb))) & 0x00ffffff) | (rgb & 0xff000000);
+}
+
+/*!
+Returns a copy of \a image where every pixel is replaced by its
+nearest palette entry; alpha is preserved. The result keeps the
+format of \a image if it is QImage::Format_RGB32 or
+QImage::Format_ARGB32, and is QImage::Format_ARGB32 otherwise.
+*/
+QImage QtPaletteRemapper::remap(const QImage &image) const
+{
+	if (image.isNull() || colors.isEmpty())
+		return image;
+
+	QImage source = image;
+	if (source.format() != QImage::Format_RGB32 && source.format() != QImage::Format_ARGB32)
+		source = source.convertToFormat(QImage::Format_ARGB32);
+
+	QImage destination(source.size(), source.format());
+	if (source.bytesPerLine() == source.width() * 4 && destination.bytesPerLine() == destination.width() * 4) {
+		remap(reinterpret_cast<const QRgb *>(source.constBits()),
+			reinterpret_cast<QRgb *>(destination.bits()),
+			source.width() * source.height());
+	} else {
+		for (int y = 0; y < source.height(); ++y) {
+			remap(reinterpret_cast<const QRgb *>(source.constScanLine(y)),
+				reinterpret_cast<QRgb *>(destination.scanLine(y)),
+				source.width());
+		}
+	}
+	return destination;
+}
+
+/*!
+Remaps \a count packed ARGB32 pixels from \a source into
+\a destination, which may be the same buffer. Large buffers are cut
+into tiles processed in parallel.
+*/
+void QtPaletteRemapper::remap(const QRgb *source, QRgb *destination, int count) const
+{
+	if (colors.isEmpty()) {
+		if (source != destination)
+			memmove(destination, source, count * sizeof(QRgb));
+		return;
+	}
+
+	QtRemapKernel kernel;
+	kernel.colors = colors.constData();
+	kernel.lut = lut.constData();
+
+	QVector<QtRemapTile> tiles;
+	for (int i = 0; i < count; i += TileSize) {
+		QtRemapTile tile;
+		tile.source = source + i;
+		tile.destination = destination + i;
+		tile.count = qMin(int(TileSize), count - i);
+		tiles.append(tile);
+	}
+
+	if (tiles.size() == 1)
+		kernel(tiles.at(0));
+	else
+		QtConcurrent::blockingMap(tiles, kernel);
+}
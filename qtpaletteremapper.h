@@ -0,0 +1,38 @@
+#ifndef QTPALETTEREMAPPER_H
+#define QTPALETTEREMAPPER_H
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+
+#define QtPublicCtrlDLL
+
+/*
+    Maps colors to the nearest entry of a palette, measured in OKLab.
+    The nearest entry of every cell of a 64x64x64 RGB grid is computed
+    once when the palette is set, so remapping a pixel is a single
+    table lookup. The class is implicitly shared and reentrant: a
+    remapper can be copied to worker threads and used concurrently.
+*/
+class QtPublicCtrlDLL QtPaletteRemapper
+{
+public:
+    QtPaletteRemapper();
+    explicit QtPaletteRemapper(const QList<QColor> &palette);
+
+    void setPalette(const QList<QColor> &palette);
+    QList<QColor> palette() const;
+    bool isEmpty() const;
+
+    int nearestIndex(QRgb rgb) const;
+    QRgb nearest(QRgb rgb) const;
+
+    QImage remap(const QImage &image) const;
+    void remap(const QRgb *source, QRgb *destination, int count) const;
+
+private:
+    QVector<QRgb> colors;
+    QVector<quint16> lut;
+};
+
+#endif
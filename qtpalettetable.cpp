@@ -0,0 +1,65 @@
+#include <QtCore/QCoreApplication>
+
+#include "qtpalettetable.h"
+
+// The names keep the QtColorPicker context they were translated in
+// when the pickers inserted them one by one.
+static Q_DECL_CONSTEXPR QtPaletteEntry standardEntries[] = {
+	{ 0xff000000, QT_TRANSLATE_NOOP("QtColorPicker", "Black") },
+	{ 0xffffffff, QT_TRANSLATE_NOOP("QtColorPicker", "White") },
+	{ 0xffff0000, QT_TRANSLATE_NOOP("QtColorPicker", "Red") },
+	{ 0xff800000, QT_TRANSLATE_NOOP("QtColorPicker", "Dark red") },
+	{ 0xff00ff00, QT_TRANSLATE_NOOP("QtColorPicker", "Green") },
+	{ 0xff008000, QT_TRANSLATE_NOOP("QtColorPicker", "Dark green") },
+	{ 0xff0000ff, QT_TRANSLATE_NOOP("QtColorPicker", "Blue") },
+	{ 0xff000080, QT_TRANSLATE_NOOP("QtColorPicker", "Dark blue") },
+	{ 0xff00ffff, QT_TRANSLATE_NOOP("QtColorPicker", "Cyan") },
+	{ 0xff008080, QT_TRANSLATE_NOOP("QtColorPicker", "Dark cyan") },
+	{ 0xffff00ff, QT_TRANSLATE_NOOP("QtColorPicker", "Magenta") },
+	{ 0xff800080, QT_TRANSLATE_NOOP("QtColorPicker", "Dark magenta") },
+	{ 0xffffff00, QT_TRANSLATE_NOOP("QtColorPicker", "Yellow") },
+	{ 0xff808000, QT_TRANSLATE_NOOP("QtColorPicker", "Dark yellow") },
+	{ 0xffa0a0a4, QT_TRANSLATE_NOOP("QtColorPicker", "Gray") },
+	{ 0xff808080, QT_TRANSLATE_NOOP("QtColorPicker", "Dark gray") },
+	{ 0xffc0c0c0, QT_TRANSLATE_NOOP("QtColorPicker", "Light gray") }
+};
+
+static Q_DECL_CONSTEXPR QtPaletteEntry basicEntries[] = {
+	{ 0xff000000, 0 },
+	{ 0xffa0a0a4, 0 },
+	{ 0xffffffff, 0 },
+	{ 0xffff0000, 0 },
+	{ 0xff00ff00, 0 },
+	{ 0xff0000ff, 0 },
+	{ 0xffff00ff, 0 }
+};
+
+static Q_DECL_CONSTEXPR QtPaletteTable standardTable = qtPaletteTable("QtColorPicker", standardEntries);
+static Q_DECL_CONSTEXPR QtPaletteTable basicTable = qtPaletteTable("QtColorPicker", basicEntries);
+
+/*!
+Returns the translated name of entry \a i, or an empty string if it
+has none.
+*/
+QString QtPaletteTable::name(int i) const
+{
+	const char *key = entries[i].key;
+	return key ? QCoreApplication::translate(context, key) : QString();
+}
+
+/*!
+Returns the 17 predefined colors of the Qt namespace, named.
+*/
+const QtPaletteTable &QtPaletteTable::standard()
+{
+	return standardTable;
+}
+
+/*!
+Returns black, gray, white and the primary and secondary colors,
+unnamed.
+*/
+const QtPaletteTable &QtPaletteTable::basic()
+{
+	return basicTable;
+}
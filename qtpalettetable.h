@@ -0,0 +1,52 @@
+#ifndef QTPALETTETABLE_H
+#define QTPALETTETABLE_H
+#include <QtCore/QString>
+#include <QtGui/QColor>
+
+#define QtPublicCtrlDLL
+
+/*
+    One color of a QtPaletteTable: packed ARGB and the untranslated
+    name, marked with QT_TRANSLATE_NOOP so that lupdate finds it. A
+    null key leaves the color unnamed.
+*/
+struct QtPaletteEntry
+{
+    QRgb rgba;
+    const char *key;
+};
+
+/*
+    A palette written in code. Tables are constant data: declaring
+    one costs nothing at startup, and names are only translated, in
+    \a context, when they are first displayed.
+
+        static constexpr QtPaletteEntry traffic[] = {
+            { 0xffe53935, QT_TRANSLATE_NOOP("Traffic", "Stop") },
+            { 0xfffdd835, QT_TRANSLATE_NOOP("Traffic", "Wait") },
+            { 0xff43a047, QT_TRANSLATE_NOOP("Traffic", "Go") }
+        };
+        static constexpr QtPaletteTable trafficTable = qtPaletteTable("Traffic", traffic);
+
+        picker->insertPalette(trafficTable);
+*/
+struct QtPublicCtrlDLL QtPaletteTable
+{
+    const char *context;
+    const QtPaletteEntry *entries;
+    int count;
+
+    QColor color(int i) const { return QColor::fromRgba(entries[i].rgba); }
+    QString name(int i) const;
+
+    static const QtPaletteTable &standard();
+    static const QtPaletteTable &basic();
+};
+
+template <int N>
+Q_DECL_CONSTEXPR inline QtPaletteTable qtPaletteTable(const char *context, const QtPaletteEntry (&entries)[N])
+{
+    return { context, entries, N };
+}
+
+#endif
@@ -0,0 +1,299 @@
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMetaObject>
+#include <QtCore/QMutex>
+#include <QtCore/QPointer>
+#include <QtCore/QSharedMemory>
+
+#include "qtrecentcolors.h"
+
+enum { SegmentMagic = 0x51435243, MaxSharedColors = 64 }; // "QCRC"
+
+/*! \internal
+
+Layout of the shared memory segment. Every access is made with the
+segment locked; the generation is bumped on each write, so readers
+only copy the colors when it differs from the one they last saw.
+*/
+struct QtRecentSegment
+{
+	quint32 magic;
+	quint32 generation;
+	qint32 count;
+	QRgb colors[MaxSharedColors];
+};
+
+/*! \class QtRecentColors
+
+\brief The QtRecentColors class holds the recently used custom colors
+shared by all the color pickers of the application.
+
+The most recent color comes first. Publishing a color that is
+already in the list moves it to the front; the list holds at most
+capacity() colors.
+
+Subscribers connect to changed(), which is emitted from the event
+loop once per turn however many colors were published in between,
+so that hundreds of pickers are updated once per pick and not once
+per picker.
+
+The list can be shared between processes with setSharedKey(). Each
+change made by one process is then written to a shared memory
+segment, and picked up by the others in refresh(), which pickers call
+when their popup is shown. Checking for changes costs one lock and
+one comparison; the colors are only copied when they changed.
+*/
+
+/*!
+Returns the store of the application, creating it on first use. The
+store belongs to the application object and lives in its thread; it
+is created again if requested after the application was destroyed.
+*/
+QtRecentColors *QtRecentColors::instance()
+{
+	static QMutex mutex;
+	static QPointer<QtRecentColors> store;
+
+	QMutexLocker locker(&mutex);
+	if (!store) {
+		store = new QtRecentColors;
+		if (QCoreApplication *app = QCoreApplication::instance()) {
+			store->moveToThread(app->thread());
+			store->setParent(app);
+		}
+	}
+	return store;
+}
+
+/*! \internal
+*/
+QtRecentColors::QtRecentColors()
+	: gen(0), cap(12), notifyPending(false), segment(0), segmentGen(0)
+{
+}
+
+/*!
+Returns the recent colors, most recent first.
+*/
+QList<QColor> QtRecentColors::colors() const
+{
+	return recent;
+}
+
+/*!
+Returns a counter incremented each time the list changes. Subscribers
+can compare it to the value they last saw to skip redundant updates.
+*/
+quint32 QtRecentColors::generation() const
+{
+	return gen;
+}
+
+/*!
+Sets the maximum number of colors kept to \a capacity.
+*/
+void QtRecentColors::setCapacity(int capacity)
+{
+	cap = qMax(1, capacity);
+	if (recent.size() > cap) {
+		recent.erase(recent.begin() + cap, recent.end());
+		scheduleNotify();
+	}
+}
+int QtRecentColors::capacity() const
+{
+	return cap;
+}
+
+/*!
+Moves \a color to the front of the list, adding it if needed.
+Publishing the color that is already the most recent does nothing,
+so a color reported by several code paths is only published once.
+*/
+void QtRecentColors::publish(const QColor &color)
+{
+	if (!color.isValid())
+		return;
+
+	// Start from what the other processes published, not to drop it.
+	const bool shared = lockShared();
+	if (shared)
+		pullShared();
+
+	if (recent.isEmpty() || recent.first().rgba() != color.rgba()) {
+		for (int i = 0; i < recent.size(); ++i) {
+			if (recent.at(i).rgba() == color.rgba()) {
+				recent.removeAt(i);
+				break;
+			}
+		}
+		recent.prepend(color);
+		while (recent.size() > cap)
+			recent.removeLast();
+
+		if (shared)
+			pushShared();
+		scheduleNotify();
+	}
+
+	if (shared)
+		segment->unlock();
+}
+
+/*!
+Removes all the colors.
+*/
+void QtRecentColors::clear()
+{
+	const bool shared = lockShared();
+	if (shared)
+		pullShared();
+
+	if (!recent.isEmpty()) {
+		recent.clear();
+		if (shared)
+			pushShared();
+		scheduleNotify();
+	}
+
+	if (shared)
+		segment->unlock();
+}
+
+/*!
+Shares the list with the other processes that use the same \a key,
+through a shared memory segment. The first process to attach seeds
+the segment with its colors; the others take the colors found there.
+An empty \a key stops sharing.
+
+Returns false if the segment could not be created or attached; the
+list then stays local to this process.
+
+\sa refresh()
+*/
+bool QtRecentColors::setSharedKey(const QString &key)
+{
+	if (segment && segment->key() == key)
+		return true;
+
+	delete segment;
+	segment = 0;
+	segmentGen = 0;
+	if (key.isEmpty())
+		return true;
+
+	segment = new QSharedMemory(key, this);
+	if (!segment->create(sizeof(QtRecentSegment))
+		&& (segment->error() != QSharedMemory::AlreadyExists || !segment->attach())) {
+		delete segment;
+		segment = 0;
+		return false;
+	}
+
+	if (!lockShared()) {
+		delete segment;
+		segment = 0;
+		return false;
+	}
+
+	QtRecentSegment *data = static_cast<QtRecentSegment *>(segment->data());
+	if (data->magic != SegmentMagic) {
+		data->magic = SegmentMagic;
+		data->generation = 0;
+		data->count = 0;
+		pushShared();
+	} else {
+		pullShared();
+	}
+	segment->unlock();
+	return true;
+}
+
+QString QtRecentColors::sharedKey() const
+{
+	return segment ? segment->key() : QString();
+}
+
+/*!
+Takes the colors published by the other processes since the last
+call, if any, and returns true if the list changed. Does nothing
+when the list is not shared.
+*/
+bool QtRecentColors::refresh()
+{
+	if (!lockShared())
+		return false;
+
+	const quint32 previous = gen;
+	pullShared();
+	segment->unlock();
+	return gen != previous;
+}
+
+/*! \internal
+
+Locks the shared segment, if there is one.
+*/
+bool QtRecentColors::lockShared()
+{
+	return segment && segment->isAttached() && segment->lock();
+}
+
+/*! \internal
+
+Copies the shared colors if another process changed them. The
+segment must be locked.
+*/
+void QtRecentColors::pullShared()
+{
+	const QtRecentSegment *data = static_cast<const QtRecentSegment *>(segment->constData());
+	if (data->magic != SegmentMagic || data->generation == segmentGen)
+		return;
+
+	segmentGen = data->generation;
+	const int count = qBound(0, int(data->count), qMin(cap, int(MaxSharedColors)));
+	QList<QColor> colors;
+	colors.reserve(count);
+	for (int i = 0; i < count; ++i)
+		colors.append(QColor::fromRgba(data->colors[i]));
+
+	if (colors != recent) {
+		recent = colors;
+		scheduleNotify();
+	}
+}
+
+/*! \internal
+
+Writes the colors to the shared segment, which must be locked.
+*/
+void QtRecentColors::pushShared()
+{
+	QtRecentSegment *data = static_cast<QtRecentSegment *>(segment->data());
+	const int count = qMin(recent.size(), int(MaxSharedColors));
+	for (int i = 0; i < count; ++i)
+		data->colors[i] = recent.at(i).rgba();
+	data->count = count;
+	segmentGen = ++data->generation;
+}
+
+/*! \internal
+
+Bumps the generation and queues changed() unless it already is.
+*/
+void QtRecentColors::scheduleNotify()
+{
+	++gen;
+	if (notifyPending)
+		return;
+
+	notifyPending = true;
+	QMetaObject::invokeMethod(this, "notify", Qt::QueuedConnection);
+}
+
+/*! \internal
+*/
+void QtRecentColors::notify()
+{
+	notifyPending = false;
+	emit changed();
+}
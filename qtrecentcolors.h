@@ -0,0 +1,64 @@
+#ifndef QTRECENTCOLORS_H
+#define QTRECENTCOLORS_H
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtGui/QColor>
+
+#define QtPublicCtrlDLL
+
+class QSharedMemory;
+
+/*
+    The process wide list of recently used custom colors, shared by
+    every QtColorPicker that opted in with setSharedRecentColors().
+    Any number of publish() calls made during one event loop turn
+    result in a single changed() signal.
+
+    With setSharedKey(), the list also lives in a shared memory
+    segment, so that the processes of an application suite see each
+    other's colors.
+*/
+class QtPublicCtrlDLL QtRecentColors : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QtRecentColors *instance();
+
+    QList<QColor> colors() const;
+    quint32 generation() const;
+
+    void setCapacity(int capacity);
+    int capacity() const;
+
+    bool setSharedKey(const QString &key);
+    QString sharedKey() const;
+
+public Q_SLOTS:
+    void publish(const QColor &color);
+    void clear();
+    bool refresh();
+
+Q_SIGNALS:
+    void changed();
+
+private Q_SLOTS:
+    void notify();
+
+private:
+    QtRecentColors();
+    void scheduleNotify();
+    bool lockShared();
+    void pullShared();
+    void pushShared();
+
+    QList<QColor> recent;
+    quint32 gen;
+    int cap;
+    bool notifyPending;
+    QSharedMemory *segment;
+    quint32 segmentGen;
+};
+
+#endif
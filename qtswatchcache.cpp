@@ -0,0 +1,330 @@
+#include <QtCore/QCoreApplication>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <QtCore/qmath.h>
+#include <QtGui/QPainter>
+#include <QtGui/QPixmapCache>
+
+#include "qtswatchcache.h"
+
+enum {
+	CheckerSquare = 4,
+	SheetColumns = 16,
+	SheetRows = 16,
+	DefaultCacheLimit = 8 * 1024 // kilobytes
+};
+
+/*! \internal
+
+Identifies a tile: its color and state, and its size in device
+pixels together with the device pixel ratio, in hundredths.
+*/
+struct QtSwatchKey
+{
+	QRgb rgba;
+	quint16 width;
+	quint16 height;
+	quint16 dpr;
+	quint8 state;
+
+	bool operator==(const QtSwatchKey &other) const
+	{
+		return rgba == other.rgba && width == other.width && height == other.height
+			&& dpr == other.dpr && state == other.state;
+	}
+};
+
+static inline uint qHash(const QtSwatchKey &key)
+{
+	return key.rgba ^ (uint(key.width) << 20) ^ (uint(key.height) << 10) ^ (uint(key.dpr) << 3) ^ key.state;
+}
+
+/*! \internal
+
+A sheet of SheetColumns x SheetRows tiles of one size. Each slot
+remembers the key it holds and when it was last drawn.
+*/
+struct QtSwatchSheet
+{
+	QPixmap pixmap;
+	QtSwatchKey geometry;
+	QVector<QtSwatchKey> keys;
+	QVector<quint64> lastUse;
+	int used;
+	quint64 sheetUse;
+
+	int bytes() const { return pixmap.width() * pixmap.height() * 4; }
+};
+
+/*! \internal
+
+The atlas itself. It is only used from the GUI thread, like the
+pixmaps it holds.
+*/
+struct QtSwatchAtlas
+{
+	QList<QtSwatchSheet *> sheets;
+	QHash<QtSwatchKey, QPair<QtSwatchSheet *, int> > index;
+	quint64 clock;
+	int bytes;
+	int limit;
+
+	QtSwatchAtlas() : clock(0), bytes(0), limit(DefaultCacheLimit * 1024) {}
+	~QtSwatchAtlas() { clear(); }
+
+	void clear()
+	{
+		qDeleteAll(sheets);
+		sheets.clear();
+		index.clear();
+		bytes = 0;
+	}
+
+	void dropSheet(QtSwatchSheet *sheet)
+	{
+		for (int i = 0; i < sheet->used; ++i)
+			index.remove(sheet->keys.at(i));
+		bytes -= sheet->bytes();
+		sheets.removeOne(sheet);
+		delete sheet;
+	}
+
+	QPair<QtSwatchSheet *, int> slotFor(const QtSwatchKey &key);
+};
+
+static void clearAtlas();
+
+static QtSwatchAtlas &atlas()
+{
+	static QtSwatchAtlas instance;
+	static bool registered = false;
+	if (!registered) {
+		// The pixmaps must go before the application does.
+		qAddPostRoutine(clearAtlas);
+		registered = true;
+	}
+	return instance;
+}
+
+static void clearAtlas()
+{
+	atlas().clear();
+}
+
+static inline bool sameGeometry(const QtSwatchKey &k1, const QtSwatchKey &k2)
+{
+	return k1.width == k2.width && k1.height == k2.height && k1.dpr == k2.dpr;
+}
+
+/*! \internal
+
+Returns a slot for the new tile \a key: a free slot of a sheet of its
+size, a slot of a new sheet if the limit allows, or else the least
+recently used tile of its size.
+*/
+QPair<QtSwatchSheet *, int> QtSwatchAtlas::slotFor(const QtSwatchKey &key)
+{
+	QtSwatchSheet *lruSheet = 0;
+	int lruSlot = -1;
+	for (int i = 0; i < sheets.size(); ++i) {
+		QtSwatchSheet *sheet = sheets.at(i);
+		if (!sameGeometry(sheet->geometry, key))
+			continue;
+		if (sheet->used < sheet->keys.size())
+			return qMakePair(sheet, sheet->used++);
+		for (int s = 0; s < sheet->used; ++s) {
+			if (!lruSheet || sheet->lastUse.at(s) < lruSheet->lastUse.at(lruSlot)) {
+				lruSheet = sheet;
+				lruSlot = s;
+			}
+		}
+	}
+
+	const int sheetBytes = SheetColumns * key.width * SheetRows * key.height * 4;
+	if (lruSheet && bytes + sheetBytes > limit) {
+		index.remove(lruSheet->keys.at(lruSlot));
+		return qMakePair(lruSheet, lruSlot);
+	}
+
+	// No tile of this size to reuse: make room by dropping whole
+	// sheets of other sizes, least recently used first.
+	while (!lruSheet && !sheets.isEmpty() && bytes + sheetBytes > limit) {
+		QtSwatchSheet *oldest = sheets.first();
+		for (int i = 1; i < sheets.size(); ++i) {
+			if (sheets.at(i)->sheetUse < oldest->sheetUse)
+				oldest = sheets.at(i);
+		}
+		dropSheet(oldest);
+	}
+
+	QtSwatchSheet *sheet = new QtSwatchSheet;
+	sheet->geometry = key;
+	sheet->pixmap = QPixmap(SheetColumns * key.width, SheetRows * key.height);
+	sheet->pixmap.fill(Qt::transparent);
+	sheet->keys.resize(SheetColumns * SheetRows);
+	sheet->lastUse.resize(SheetColumns * SheetRows);
+	sheet->used = 1;
+	sheet->sheetUse = clock;
+	sheets.append(sheet);
+	bytes += sheet->bytes();
+	return qMakePair(sheet, 0);
+}
+
+/*! \internal
+
+Renders the tile of \a color in \a state into \a target, in logical
+pixels, over what \a p already holds there.
+*/
+static void renderTile(QPainter &p, const QRectF &target, const QColor &color, QtSwatchCache::State state, qreal dpr)
+{
+	const QRectF inner = state == QtSwatchCache::Plain ? target : target.adjusted(1, 1, -1, -1);
+	if (color.alpha() < 255)
+		p.drawTiledPixmap(inner, QtSwatchCache::checkerboard(dpr));
+	p.fillRect(inner, color);
+	if (state == QtSwatchCache::Plain)
+		return;
+
+	QColor border("#5c5c5c");
+	qreal radius = 2;
+	if (state == QtSwatchCache::Hover)
+		border = QColor("#7EB4EA");
+	else if (state == QtSwatchCache::Focus || state == QtSwatchCache::Selected) {
+		border = Qt::black;
+		radius = 1;
+	}
+
+	p.setRenderHint(QPainter::Antialiasing);
+	p.setBrush(Qt::NoBrush);
+	p.setPen(QPen(border, 1));
+	p.drawRoundedRect(target.adjusted(0.5, 0.5, -0.5, -0.5), radius, radius);
+	if (state == QtSwatchCache::Selected) {
+		p.setPen(QPen(Qt::white, 1));
+		p.drawRect(target.adjusted(1.5, 1.5, -1.5, -1.5));
+	}
+	p.setRenderHint(QPainter::Antialiasing, false);
+}
+
+/*!
+Returns a tile of the checkerboard drawn behind translucent colors,
+two squares wide, rendered for \a devicePixelRatio.
+*/
+QPixmap QtSwatchCache::checkerboard(qreal devicePixelRatio)
+{
+	const QString key = QString::fromLatin1("qtswatch_checker_%1").arg(devicePixelRatio);
+	QPixmap tile;
+	if (QPixmapCache::find(key, &tile))
+		return tile;
+
+	const int side = qRound(2 * CheckerSquare * devicePixelRatio);
+	tile = QPixmap(side, side);
+	tile.fill(Qt::white);
+	{
+		QPainter p(&tile);
+		p.fillRect(0, 0, side / 2, side / 2, Qt::lightGray);
+		p.fillRect(side / 2, side / 2, side - side / 2, side - side / 2, Qt::lightGray);
+	}
+	tile.setDevicePixelRatio(devicePixelRatio);
+	QPixmapCache::insert(key, tile);
+	return tile;
+}
+
+/*!
+Fills \a rect with the swatch of \a color in \a state using
+\a painter. Plain swatches have no border; the others are drawn the
+way grid items are in that state.
+
+Opaque plain swatches are filled directly. Grid swatches are drawn
+from the atlas, rendering the tile first if it is not there yet.
+Translucent plain swatches, such as the picker button face, come in
+arbitrary sizes and are rendered directly too: a sheet of such tiles
+would hold a single one and push the grid tiles out of the atlas.
+*/
+void QtSwatchCache::paint(QPainter *painter, const QRect &rect, const QColor &color, State state)
+{
+	if (state == Plain && color.alpha() == 255) {
+		painter->fillRect(rect, color);
+		return;
+	}
+
+	const qreal dpr = painter->device() ? painter->device()->devicePixelRatioF() : 1;
+	QtSwatchKey key;
+	key.rgba = color.rgba();
+	key.width = quint16(qCeil(rect.width() * dpr));
+	key.height = quint16(qCeil(rect.height() * dpr));
+	key.dpr = quint16(qRound(dpr * 100));
+	key.state = quint8(state);
+	if (!key.width || !key.height)
+		return;
+
+	// Keep the atlas for the small tiles it was made for; a sheet
+	// taking a large share of the limit would evict everything else.
+	QtSwatchAtlas &cache = atlas();
+	const qint64 sheetBytes = qint64(SheetColumns) * key.width * SheetRows * key.height * 4;
+	if (state == Plain || sheetBytes > cache.limit / 4) {
+		painter->save();
+		renderTile(*painter, QRectF(rect), color, state, dpr);
+		painter->restore();
+		return;
+	}
+
+	++cache.clock;
+	QHash<QtSwatchKey, QPair<QtSwatchSheet *, int> >::const_iterator it = cache.index.constFind(key);
+	QPair<QtSwatchSheet *, int> slot;
+	if (it != cache.index.constEnd()) {
+		slot = it.value();
+	} else {
+		slot = cache.slotFor(key);
+		slot.first->keys[slot.second] = key;
+		cache.index.insert(key, slot);
+
+		const QRect target((slot.second % SheetColumns) * key.width, (slot.second / SheetColumns) * key.height,
+			key.width, key.height);
+		QPainter p(&slot.first->pixmap);
+		p.setClipRect(target);
+		p.setCompositionMode(QPainter::CompositionMode_Source);
+		p.fillRect(target, Qt::transparent);
+		p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+		p.translate(target.topLeft());
+		p.scale(dpr, dpr);
+		renderTile(p, QRectF(QPointF(0, 0), QSizeF(key.width / dpr, key.height / dpr)), color, state, dpr);
+	}
+
+	slot.first->lastUse[slot.second] = cache.clock;
+	slot.first->sheetUse = cache.clock;
+
+	const int x = (slot.second % SheetColumns) * key.width;
+	const int y = (slot.second / SheetColumns) * key.height;
+	painter->drawPixmap(QRectF(rect), slot.first->pixmap, QRectF(x, y, key.width, key.height));
+}
+
+/*!
+Sets the memory the atlas may use to \a kilobytes; sheets above the
+limit are dropped, least recently used first.
+*/
+void QtSwatchCache::setCacheLimit(int kilobytes)
+{
+	QtSwatchAtlas &cache = atlas();
+	cache.limit = qMax(0, kilobytes) * 1024;
+	while (!cache.sheets.isEmpty() && cache.bytes > cache.limit) {
+		QtSwatchSheet *oldest = cache.sheets.first();
+		for (int i = 1; i < cache.sheets.size(); ++i) {
+			if (cache.sheets.at(i)->sheetUse < oldest->sheetUse)
+				oldest = cache.sheets.at(i);
+		}
+		cache.dropSheet(oldest);
+	}
+}
+
+int QtSwatchCache::cacheLimit()
+{
+	return atlas().limit / 1024;
+}
+
+/*!
+Drops all the rendered tiles.
+*/
+void QtSwatchCache::clear()
+{
+	atlas().clear();
+}
@@ -0,0 +1,38 @@
+#ifndef QTSWATCHCACHE_H
+#define QTSWATCHCACHE_H
+#include <QtGui/QColor>
+#include <QtGui/QPixmap>
+
+#define QtPublicCtrlDLL
+
+class QPainter;
+
+/*
+    A process wide atlas of pre-rendered color swatches, shared by
+    every popup and picker. A swatch is rendered once per color,
+    state, size and device pixel ratio into a slot of a sheet, a large
+    pixmap holding all the tiles of one size; drawing it is then a
+    single blit from the sheet.
+
+    Sheets are allocated until cacheLimit() is reached. Past it, the
+    least recently used tile of the same size is overwritten, or, if
+    there is none, the least recently used sheets are dropped; at
+    least one sheet is always kept.
+    Translucent colors are composited over a checkerboard. Plain
+    swatches, and tiles too large for a sheet to fit the limit
+    comfortably, are drawn directly instead.
+*/
+class QtPublicCtrlDLL QtSwatchCache
+{
+public:
+    enum State { Plain, Normal, Hover, Focus, Selected };
+
+    static QPixmap checkerboard(qreal devicePixelRatio = 1);
+    static void paint(QPainter *painter, const QRect &rect, const QColor &color, State state = Plain);
+
+    static void setCacheLimit(int kilobytes);
+    static int cacheLimit();
+    static void clear();
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+#include <QtWidgets/QApplication>
+#include <algorithm>
+
+#include "qtcolorpicker.h"
+#include "qtswatchcache.h"
+
+/*
+    Renders QtColorPicker and ColorPickerPopup into offscreen images,
+    at several device pixel ratios, palette sizes and states, and
+    prints the paint time percentiles of each configuration as JSON,
+    along with the number of style re-polishes and layout passes seen
+    while setting it up and while painting it.
+
+    Usage: paintprofile [frames] [output.json]
+
+    The offscreen platform is used unless QT_QPA_PLATFORM says
+    otherwise, so the numbers do not depend on a window system.
+*/
+
+enum { DefaultFrames = 200 };
+
+/*
+    Counts the events behind the costs that do not show in the paint
+    time itself: style changes and polishes, and layout requests.
+*/
+class EventCounter : public QObject
+{
+public:
+	EventCounter() : polishes(0), layouts(0) {}
+
+	bool eventFilter(QObject *, QEvent *e)
+	{
+		switch (e->type()) {
+		case QEvent::Polish:
+		case QEvent::StyleChange:
+			++polishes;
+			break;
+		case QEvent::LayoutRequest:
+			++layouts;
+			break;
+		default:
+			break;
+		}
+		return false;
+	}
+
+	void reset()
+	{
+		polishes = 0;
+		layouts = 0;
+	}
+
+	int polishes;
+	int layouts;
+};
+
+static QList<QColor> makePalette(int count, int alpha)
+{
+	QList<QColor> colors;
+	for (int i = 0; i < count; ++i) {
+		QColor color = QColor::fromHsv(i * 359 / count, 80 + (i * 37) % 176, 90 + (i * 53) % 166);
+		color.setAlpha(alpha);
+		colors.append(color);
+	}
+	return colors;
+}
+
+static qint64 percentile(const QVector<qint64> &sorted, double p)
+{
+	return sorted.at(qMin(sorted.size() - 1, int(p * sorted.size())));
+}
+
+/*
+    Paints \a widget \a frames times at \a dpr, after one cold frame,
+    and returns the timings. Layout requests posted by the setup are
+    delivered first, so that they are counted with the setup.
+*/
+static QJsonObject profile(QWidget *widget, qreal dpr, int frames, EventCounter &counter)
+{
+	QCoreApplication::sendPostedEvents();
+	QJsonObject result;
+	result.insert("setupPolishes", counter.polishes);
+	result.insert("setupLayouts", counter.layouts);
+	counter.reset();
+
+	QImage image(widget->size() * dpr, QImage::Format_ARGB32_Premultiplied);
+	image.setDevicePixelRatio(dpr);
+
+	QElapsedTimer timer;
+	timer.start();
+	widget->render(&image);
+	result.insert("firstFrameUs", double(timer.nsecsElapsed() / 1000));
+
+	QVector<qint64> times;
+	times.reserve(frames);
+	for (int i = 0; i < frames; ++i) {
+		timer.restart();
+		widget->render(&image);
+		QCoreApplication::sendPostedEvents();
+		times.append(timer.nsecsElapsed() / 1000);
+	}
+	std::sort(times.begin(), times.end());
+
+	result.insert("p50Us", double(percentile(times, 0.50)));
+	result.insert("p90Us", double(percentile(times, 0.90)));
+	result.insert("p99Us", double(percentile(times, 0.99)));
+	result.insert("maxUs", double(times.last()));
+	result.insert("framePolishes", counter.polishes);
+	result.insert("frameLayouts", counter.layouts);
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication app(argc, argv);
+
+	const QStringList args = app.arguments();
+	const int frames = args.size() > 1 ? qMax(1, args.at(1).toInt()) : int(DefaultFrames);
+
+	EventCounter counter;
+	app.installEventFilter(&counter);
+
+	static const qreal ratios[] = { 1, 1.5, 2 };
+	static const int sizes[] = { 16, 64, 256 };
+	static const char *const states[] = { "normal", "selected", "hover", "translucent" };
+
+	QJsonArray results;
+	for (unsigned r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r) {
+		for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+			for (unsigned k = 0; k < sizeof(states) / sizeof(states[0]); ++k) {
+				const QString state = QLatin1String(states[k]);
+				const QList<QColor> colors = makePalette(sizes[s], state == "translucent" ? 128 : 255);
+
+				// The picker button.
+				QtSwatchCache::clear();
+				counter.reset();
+				{
+					QtColorPicker picker;
+					picker.insertColors(colors);
+					picker.setCurrentColor(colors.at(colors.size() / 2));
+					picker.resize(picker.sizeHint().expandedTo(QSize(60, 24)));
+					picker.ensurePolished();
+
+					QJsonObject result = profile(&picker, ratios[r], frames, counter);
+					result.insert("widget", QLatin1String("QtColorPicker"));
+					result.insert("state", state);
+					result.insert("colors", sizes[s]);
+					result.insert("dpr", ratios[r]);
+					results.append(result);
+				}
+
+				// The popup, embedded so that it can be rendered without
+				// being shown.
+				QtSwatchCache::clear();
+				counter.reset();
+				{
+					ColorPickerPopup popup(-1, true, 0, Qt::Widget);
+					popup.insertColors(colors, QStringList());
+					const QList<ColorPickerItem *> items = popup.findChildren<ColorPickerItem *>();
+					if (state == "selected" && !items.isEmpty())
+						popup.select(items.at(items.size() / 2));
+					else if (state == "hover" && !items.isEmpty())
+						items.at(items.size() / 2)->setAttribute(Qt::WA_UnderMouse, true);
+					popup.prepare();
+					popup.resize(popup.sizeHint());
+
+					QJsonObject result = profile(&popup, ratios[r], frames, counter);
+					result.insert("widget", QLatin1String("ColorPickerPopup"));
+					result.insert("state", state);
+					result.insert("colors", sizes[s]);
+					result.insert("dpr", ratios[r]);
+					results.append(result);
+				}
+			}
+		}
+	}
+
+	QJsonObject report;
+	report.insert("qt", QLatin1String(qVersion()));
+	report.insert("platform", QGuiApplication::platformName());
+	report.insert("frames", frames);
+	report.insert("results", results);
+	const QByteArray json = QJsonDocument(report).toJson();
+
+	if (args.size() > 2) {
+		QFile file(args.at(2));
+		if (!file.open(QIODevice::WriteOnly)) {
+			qWarning("paintprofile: cannot write %s", qPrintable(args.at(2)));
+			return 1;
+		}
+		file.write(json);
+	} else {
+		QFile out;
+		out.open(stdout, QIODevice::WriteOnly);
+		out.write(json);
+	}
+	return 0;
+}
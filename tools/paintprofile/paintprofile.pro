@@ -0,0 +1,11 @@
+# Offscreen paint cost harness for the color picker widgets.
+# Run it twice, on two builds, and compare the JSON outputs.
+
+TARGET = paintprofile
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../QtPublicCtrl.pri)
+
+SOURCES += main.cpp
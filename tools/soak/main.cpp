@@ -0,0 +1,281 @@
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QVector>
+#include <QtGui/QKeyEvent>
+#include <QtWidgets/QApplication>
+#include <algorithm>
+#include <random>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+#include "qtcolorpicker.h"
+
+/*
+    Creates N pickers under the offscreen platform and drives them
+    with random operations for a fixed time: setCurrentColor() with
+    known and new colors, opening and closing the popup, keyboard
+    navigation in it, and palette edits. Prints the latency
+    percentiles of each operation as JSON, with samples of the
+    resident memory, the object and widget counts and the number of
+    grid entries taken over the run, so that growth under sustained
+    load shows up.
+
+    Usage: soak [pickers] [seconds] [output.json] [seed]
+
+    The offscreen platform is used unless QT_QPA_PLATFORM says
+    otherwise.
+*/
+
+enum {
+	DefaultPickers = 1000,
+	MaxPickers = 10000,
+	DefaultSeconds = 60,
+	Samples = 20,
+	EventsEvery = 64
+};
+
+enum Operation {
+	SetKnownColor,
+	SetNewColor,
+	OpenPopup,
+	Navigate,
+	ClosePopup,
+	InsertColor,
+	RemoveColor,
+	OperationCount
+};
+
+static const char *const operationNames[OperationCount] = {
+	"setKnownColor",
+	"setNewColor",
+	"openPopup",
+	"navigate",
+	"closePopup",
+	"insertColor",
+	"removeColor"
+};
+
+/*
+    Returns the current and peak resident set sizes, in KB, or 0 where
+    the platform does not tell.
+*/
+static void residentSize(qint64 *current, qint64 *peak)
+{
+	*current = 0;
+	*peak = 0;
+#if defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		*current = qint64(counters.WorkingSetSize / 1024);
+		*peak = qint64(counters.PeakWorkingSetSize / 1024);
+	}
+#elif defined(Q_OS_LINUX)
+	QFile status(QLatin1String("/proc/self/status"));
+	if (!status.open(QIODevice::ReadOnly))
+		return;
+	const QList<QByteArray> lines = status.readAll().split('\n');
+	for (int i = 0; i < lines.size(); ++i) {
+		const QByteArray &line = lines.at(i);
+		if (line.startsWith("VmRSS:"))
+			*current = line.mid(6).trimmed().split(' ').value(0).toLongLong();
+		else if (line.startsWith("VmHWM:"))
+			*peak = line.mid(6).trimmed().split(' ').value(0).toLongLong();
+	}
+#endif
+}
+
+/*
+    Counts the objects reachable from the top level widgets: Qt has no
+    public count of all the live QObjects, but every object the
+    pickers create hangs below one of them. Popups are windows too,
+    yet they are children of their picker: only parentless windows
+    are walked so that no subtree is counted twice.
+*/
+static int objectCount()
+{
+	int count = 0;
+	const QWidgetList windows = QApplication::topLevelWidgets();
+	for (int i = 0; i < windows.size(); ++i) {
+		QWidget *window = windows.at(i);
+		if (!window->parentWidget())
+			count += 1 + window->findChildren<QObject *>().size();
+	}
+	return count;
+}
+
+static QJsonObject sample(qint64 elapsedMs, const QList<QtColorPicker *> &pickers)
+{
+	qint64 rss = 0;
+	qint64 peak = 0;
+	residentSize(&rss, &peak);
+
+	int entries = 0;
+	for (int i = 0; i < pickers.size(); ++i)
+		entries += pickers.at(i)->colorPalette().count();
+
+	QJsonObject result;
+	result.insert("elapsedMs", double(elapsedMs));
+	result.insert("rssKb", double(rss));
+	result.insert("peakRssKb", double(peak));
+	result.insert("objects", objectCount());
+	result.insert("widgets", QApplication::allWidgets().size());
+	result.insert("gridEntries", entries);
+	return result;
+}
+
+static qint64 percentile(const QVector<qint64> &sorted, double p)
+{
+	return sorted.at(qMin(sorted.size() - 1, int(p * sorted.size())));
+}
+
+int main(int argc, char **argv)
+{
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication app(argc, argv);
+
+	const QStringList args = app.arguments();
+	const int count = args.size() > 1 ? qBound(1, args.at(1).toInt(), int(MaxPickers)) : int(DefaultPickers);
+	const int seconds = args.size() > 2 ? qMax(1, args.at(2).toInt()) : int(DefaultSeconds);
+	const unsigned seed = args.size() > 4 ? args.at(4).toUInt() : 1;
+	std::mt19937 random(seed);
+
+	QElapsedTimer clock;
+	clock.start();
+
+	QWidget window;
+	QList<QtColorPicker *> pickers;
+	pickers.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		QtColorPicker *picker = new QtColorPicker(&window);
+		picker->setStandardColors();
+		pickers.append(picker);
+	}
+	window.show();
+	QCoreApplication::processEvents();
+	const qint64 setupMs = clock.elapsed();
+
+	QVector<qint64> times[OperationCount];
+	QJsonArray samples;
+	samples.append(sample(0, pickers));
+
+	static const int keys[] = { Qt::Key_Left, Qt::Key_Right, Qt::Key_Up, Qt::Key_Down, Qt::Key_Home, Qt::Key_End };
+	const qint64 duration = qint64(seconds) * 1000;
+	const qint64 sampleEvery = duration / Samples;
+	qint64 nextSample = sampleEvery;
+	QtColorPicker *open = 0;
+	ColorPickerPopup *openPopup = 0;
+
+	QElapsedTimer run;
+	QElapsedTimer timer;
+	run.start();
+	for (int step = 0; run.elapsed() < duration; ++step) {
+		// Keyboard navigation and closing only make sense while a
+		// popup is open; any other operation closes it first.
+		Operation op = Operation(random() % OperationCount);
+		if (!open && (op == Navigate || op == ClosePopup))
+			op = OpenPopup;
+		if (open && op != Navigate && op != ClosePopup) {
+			openPopup->hide();
+			open = 0;
+			openPopup = 0;
+		}
+
+		QtColorPicker *picker = pickers.at(int(random() % unsigned(count)));
+		const QRgb rgb = qRgb(random() & 0xff, random() & 0xff, random() & 0xff);
+
+		timer.start();
+		switch (op) {
+		case SetKnownColor:
+			picker->setCurrentColor(picker->color(int(random() % 17)));
+			break;
+		case SetNewColor:
+			picker->setCurrentColor(QColor(rgb));
+			break;
+		case OpenPopup:
+			open = picker;
+			openPopup = picker->findChild<ColorPickerPopup *>();
+			picker->setChecked(true);
+			break;
+		case Navigate: {
+			QKeyEvent press(QEvent::KeyPress, keys[random() % (sizeof(keys) / sizeof(keys[0]))], Qt::NoModifier);
+			QCoreApplication::sendEvent(openPopup, &press);
+			break;
+		}
+		case ClosePopup:
+			openPopup->hide();
+			open = 0;
+			openPopup = 0;
+			break;
+		case InsertColor:
+			picker->insertColor(QColor(rgb), QString());
+			break;
+		case RemoveColor:
+			picker->removeColor(int(random() % 32));
+			break;
+		default:
+			break;
+		}
+		times[op].append(timer.nsecsElapsed() / 1000);
+
+		// Deferred work, such as the recent colors notification and
+		// deleteLater(), runs in the event loop.
+		if (step % EventsEvery == 0)
+			QCoreApplication::processEvents();
+
+		if (run.elapsed() >= nextSample) {
+			samples.append(sample(run.elapsed(), pickers));
+			nextSample += sampleEvery;
+		}
+	}
+	if (openPopup)
+		openPopup->hide();
+	QCoreApplication::processEvents();
+
+	QJsonArray operations;
+	for (int i = 0; i < OperationCount; ++i) {
+		QVector<qint64> &sorted = times[i];
+		QJsonObject result;
+		result.insert("operation", QLatin1String(operationNames[i]));
+		result.insert("count", sorted.size());
+		if (!sorted.isEmpty()) {
+			std::sort(sorted.begin(), sorted.end());
+			result.insert("p50Us", double(percentile(sorted, 0.50)));
+			result.insert("p90Us", double(percentile(sorted, 0.90)));
+			result.insert("p99Us", double(percentile(sorted, 0.99)));
+			result.insert("maxUs", double(sorted.last()));
+		}
+		operations.append(result);
+	}
+
+	QJsonObject report;
+	report.insert("qt", QLatin1String(qVersion()));
+	report.insert("platform", QGuiApplication::platformName());
+	report.insert("pickers", count);
+	report.insert("seconds", seconds);
+	report.insert("seed", double(seed));
+	report.insert("setupMs", double(setupMs));
+	report.insert("operations", operations);
+	report.insert("samples", samples);
+	const QByteArray json = QJsonDocument(report).toJson();
+
+	if (args.size() > 3) {
+		QFile file(args.at(3));
+		if (!file.open(QIODevice::WriteOnly)) {
+			qWarning("soak: cannot write %s", qPrintable(args.at(3)));
+			return 1;
+		}
+		file.write(json);
+	} else {
+		QFile out;
+		out.open(stdout, QIODevice::WriteOnly);
+		out.write(json);
+	}
+	return 0;
+}
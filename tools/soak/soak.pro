@@ -0,0 +1,14 @@
+# Soak test for the color picker widgets: thousands of live pickers
+# driven with random operations for a fixed time, reporting latency
+# percentiles and growth of memory, objects and grid entries.
+
+TARGET = soak
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../../QtPublicCtrl.pri)
+
+win32:LIBS += -lpsapi
+
+SOURCES += main.cpp